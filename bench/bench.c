@@ -0,0 +1,127 @@
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "physics.h"
+#include "thing.h"
+
+typedef struct Bench {
+  const char* name;
+  Result (*run)();
+} Bench;
+
+static const Bench BENCHES[] = {
+    {"broadphase", benchBroadphase},
+    {"integrate", benchIntegrate},
+    {"slab", benchSlab},
+    {"threads", benchThreads},
+    {"contacts", benchContacts},
+    {"lists", benchLists},
+    {"uniforms", benchUniforms},
+    {"scene", benchSceneLoad},
+};
+
+#define N_BENCHES (int)(sizeof(BENCHES) / sizeof(BENCHES[0]))
+
+double benchNow() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+Result benchIsolated(void (*f)(void* arg), void* arg) {
+  // the child's copy of anything still buffered would be printed twice
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return Err;
+  }
+
+  if (pid == 0) {
+    thingsInit();
+    f(arg);
+    fflush(stdout);
+    _exit(0);
+  }
+
+  int status;
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+      WEXITSTATUS(status)) {
+    return Err;
+  }
+  return Ok;
+}
+
+void benchCubes(int n, int dynamic) {
+  static CubeThing cube = {.color = {1, 1, 1, 1}};
+  srand(1);
+
+  Body floor = {.pos = {0, 0, 0}, .scale = {1000, 1, 1000}};
+  thingAdd(thingLoadFromData(&cube, THING_CUBE, &floor));
+
+  int side = (int)ceil(sqrt(n));
+  for (int i = 0; i < n; i++) {
+    Body b = {
+        .pos = {(i % side) * 3.0f - side * 1.5f, 2 + (rand() % 100) * 0.1f,
+                (i / side) * 3.0f - side * 1.5f},
+        .scale = {1, 1, 1},
+        .is_dynamic = i % dynamic == 0,
+    };
+    thingAdd(thingLoadFromData(&cube, THING_CUBE, &b));
+  }
+}
+
+uint64_t benchBodyHash() {
+  uint64_t h = 14695981039346656037ull;
+  for (int i = 0; i < BODIES.n; i++) {
+    float pos[3] = {BODIES.px[i], BODIES.py[i], BODIES.pz[i]};
+    unsigned char* p = (unsigned char*)pos;
+    for (size_t k = 0; k < sizeof(pos); k++) {
+      h = (h ^ p[k]) * 1099511628211ull;
+    }
+  }
+  return h;
+}
+
+static void runBench(void* arg) {
+  if (is_err(((const Bench*)arg)->run())) exit(1);
+}
+
+int main(int argc, char** argv) {
+  LOGGER.out = getenv("BENCH_LOG") ? stderr : fopen("/dev/null", "w");
+
+  for (int a = 1; a < argc; a++) {
+    bool known = false;
+    for (int i = 0; i < N_BENCHES; i++) {
+      known |= !strcmp(argv[a], BENCHES[i].name);
+    }
+    if (!known) {
+      fprintf(stderr, "no bench called %s\n", argv[a]);
+      return 1;
+    }
+  }
+
+  int failed = 0;
+  for (int i = 0; i < N_BENCHES; i++) {
+    const Bench* b = &BENCHES[i];
+
+    bool wanted = argc < 2;
+    for (int a = 1; a < argc; a++) wanted |= !strcmp(argv[a], b->name);
+    if (!wanted) continue;
+
+    printf("\n== %s\n", b->name);
+    if (is_err(benchIsolated(runBench, (void*)b))) {
+      fprintf(stderr, "bench %s failed\n", b->name);
+      failed++;
+    }
+  }
+
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,40 @@
+#ifndef GAME_BENCH
+#define GAME_BENCH
+#include <stdint.h>
+
+#include "log.h"
+
+/*
+ * =======
+ * @BENCH
+ * =======
+ *
+ * Headless benchmarks for the numbers quoted in the history. `make bench` runs
+ * every suite; `./REPLACEMENT_BENCH broadphase slab` runs only those named.
+ * Each suite, and each size a suite measures, runs in its own forked process,
+ * so it starts from empty engine state and can't disturb the next one. Engine
+ * logging goes to /dev/null; set BENCH_LOG to see it on stderr.
+ */
+
+// seconds since some fixed point, for timing
+double benchNow();
+
+// Run f(arg) in a child process on fresh engine state and wait for it.
+Result benchIsolated(void (*f)(void* arg), void* arg);
+
+// A cube floor with n unit cubes in a grid above it, every `dynamic`th of
+// them dynamic. Heights are random, from a fixed seed.
+void benchCubes(int n, int dynamic);
+
+// 64-bit FNV-1a over every live body's position, to show two runs agree
+uint64_t benchBodyHash();
+
+Result benchBroadphase();
+Result benchIntegrate();
+Result benchSlab();
+Result benchThreads();
+Result benchContacts();
+Result benchLists();
+Result benchUniforms();
+Result benchSceneLoad();
+#endif
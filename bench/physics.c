@@ -0,0 +1,351 @@
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "jobs.h"
+#include "physics.h"
+
+#define BENCH_DT (1 / 60.0)
+
+/*
+ * ===========
+ * @BROADPHASE
+ * ===========
+ *
+ * A floor plus n cubes, a quarter of them dynamic, in ms per physicsUpdate.
+ */
+
+static void broadphaseRun(void* arg) {
+  int n = *(int*)arg;
+  benchCubes(n, 4);
+  physicsUpdate(BENCH_DT);
+
+  int ticks = 20;
+  double t = benchNow();
+  for (int i = 0; i < ticks; i++) physicsUpdate(BENCH_DT);
+  t = benchNow() - t;
+
+  printf("%8d bodies  %9.3f ms/tick\n", n, t / ticks * 1e3);
+}
+
+Result benchBroadphase() {
+  int sizes[] = {100, 1000, 10000};
+  for (int i = 0; i < 3; i++) {
+    if (is_err(benchIsolated(broadphaseRun, &sizes[i]))) return Err;
+  }
+  return Ok;
+}
+
+/*
+ * ==========
+ * @INTEGRATE
+ * ==========
+ *
+ * The integration step (save previous positions, gravity, move) over 100k
+ * dynamic bodies, done both ways: through Thing pointers in hash map order, as
+ * physics did before the body store, and over the body store's arrays.
+ */
+
+static void integrateRun(void* arg) {
+  int n = 100000, rounds = 50;
+  float dt = BENCH_DT;
+  static CubeThing cube = {.color = {1, 1, 1, 1}};
+  srand(1);
+
+  // Before the store, each thing was its own allocation with others in
+  // between, and the thing map handed them out in bucket order, which has
+  // nothing to do with allocation order. Those copies are the old layout.
+  Thing** things = malloc(sizeof(Thing*) * n);
+  void** gaps = malloc(sizeof(void*) * n);
+  for (int i = 0; i < n; i++) {
+    Body b = {.pos = {i, 5, 0}, .scale = {1, 1, 1}, .is_dynamic = true};
+    Thing* t = thingLoadFromData(&cube, THING_CUBE, &b);
+    things[i] = malloc(sizeof(Thing));
+    *things[i] = *t;
+    gaps[i] = malloc(64 + rand() % 256);
+    thingAdd(t);
+  }
+  for (int i = n - 1; i > 0; i--) {
+    int j = rand() % (i + 1);
+    Thing* t = things[i];
+    things[i] = things[j];
+    things[j] = t;
+  }
+
+  double t = benchNow();
+  for (int r = 0; r < rounds; r++) {
+    for (int i = 0; i < n; i++) {
+      Body* b = &things[i]->body;
+      if (!b->is_dynamic) continue;
+      glm_vec3_copy(b->pos, b->prev_pos);
+      if (!b->is_grounded) b->velocity[1] -= 9.8f * dt;
+      b->pos[0] += b->velocity[0] * dt;
+      b->pos[1] += b->velocity[1] * dt;
+      b->pos[2] += b->velocity[2] * dt;
+    }
+  }
+  double aos = (benchNow() - t) / rounds;
+
+  BodyStore* s = &BODIES;
+  t = benchNow();
+  for (int r = 0; r < rounds; r++) {
+    memcpy(s->ppx, s->px, sizeof(float) * s->n);
+    memcpy(s->ppy, s->py, sizeof(float) * s->n);
+    memcpy(s->ppz, s->pz, sizeof(float) * s->n);
+    for (int w = 0; w < (s->n + 63) / 64; w++) {
+      for (uint64_t m = s->dynamic[w] & ~s->grounded[w]; m; m &= m - 1) {
+        s->vy[(w << 6) + __builtin_ctzll(m)] -= 9.8f * dt;
+      }
+    }
+    for (int i = 0; i < s->n; i++) {
+      s->px[i] += s->vx[i] * dt;
+      s->py[i] += s->vy[i] * dt;
+      s->pz[i] += s->vz[i] * dt;
+    }
+  }
+  double soa = (benchNow() - t) / rounds;
+
+  printf("AoS through shuffled Thing*  %7.3f ms/tick  %5.0f M bodies/s\n",
+         aos * 1e3, n / aos / 1e6);
+  printf("SoA store                    %7.3f ms/tick  %5.0f M bodies/s\n",
+         soa * 1e3, n / soa / 1e6);
+
+  for (int i = 0; i < n; i++) {
+    free(things[i]);
+    free(gaps[i]);
+  }
+  free(things);
+  free(gaps);
+}
+
+Result benchIntegrate() { return benchIsolated(integrateRun, NULL); }
+
+/*
+ * =====
+ * @SLAB
+ * =====
+ *
+ * Ray against box throughput: aabbIntersectRay one box at a time, then
+ * aabbIntersectRayBatch eight at a time. Both see the same 512 rays and 4096
+ * boxes, and the batched hits are checked against the one-at-a-time ones.
+ */
+
+#if defined(__AVX2__)
+#define SLAB_KERNEL "AVX2"
+#elif defined(__SSE2__)
+#define SLAB_KERNEL "SSE2"
+#else
+#define SLAB_KERNEL "scalar"
+#endif
+
+static void slabRun(void* arg) {
+  int n_boxes = 4096, n_rays = 512;
+  srand(2);
+
+  Body* bodies = malloc(sizeof(Body) * n_boxes);
+  AABBBatch* batches = malloc(sizeof(AABBBatch) * n_boxes / AABB_BATCH);
+  for (int i = 0; i < n_boxes; i++) {
+    Body b = {
+        .pos = {rand() % 100 * 0.1f, rand() % 100 * 0.1f, rand() % 100 * 0.1f},
+        .halfsize = {0.5, 0.5, 0.5},
+    };
+    bodies[i] = b;
+
+    AABBBatch* batch = &batches[i / AABB_BATCH];
+    int lane = i % AABB_BATCH;
+    batch->n = AABB_BATCH;
+    batch->minx[lane] = b.pos[0] - 0.5f;
+    batch->miny[lane] = b.pos[1] - 0.5f;
+    batch->minz[lane] = b.pos[2] - 0.5f;
+    batch->maxx[lane] = b.pos[0] + 0.5f;
+    batch->maxy[lane] = b.pos[1] + 0.5f;
+    batch->maxz[lane] = b.pos[2] + 0.5f;
+    batch->idx[lane] = i;
+  }
+
+  vec3* pos = malloc(sizeof(vec3) * n_rays);
+  vec3* magnitude = malloc(sizeof(vec3) * n_rays);
+  for (int i = 0; i < n_rays; i++) {
+    for (int k = 0; k < 3; k++) {
+      pos[i][k] = rand() % 100 * 0.1f;
+      magnitude[i][k] = (rand() % 200 - 100) * 0.01f;
+    }
+  }
+
+  // summed so the calls can't be optimized away
+  volatile float sink = 0;
+
+  double t = benchNow();
+  for (int r = 0; r < n_rays; r++) {
+    for (int i = 0; i < n_boxes; i++) {
+      sink += aabbIntersectRay(pos[r], magnitude[r], &bodies[i]).time;
+    }
+  }
+  double single = benchNow() - t;
+
+  t = benchNow();
+  for (int r = 0; r < n_rays; r++) {
+    for (int i = 0; i < n_boxes / AABB_BATCH; i++) {
+      int lane;
+      Hit h = aabbIntersectRayBatch(pos[r], magnitude[r], &batches[i], &lane);
+      sink += h.time;
+    }
+  }
+  double batched = benchNow() - t;
+
+  // the batch must give the earliest hit, ties going to the lowest lane
+  int mismatches = 0;
+  for (int r = 0; r < n_rays; r++) {
+    for (int i = 0; i < n_boxes / AABB_BATCH; i++) {
+      int lane;
+      Hit h = aabbIntersectRayBatch(pos[r], magnitude[r], &batches[i], &lane);
+
+      Hit best = {.time = INFINITY};
+      int best_lane = -1;
+      for (int k = 0; k < AABB_BATCH; k++) {
+        Hit x = aabbIntersectRay(pos[r], magnitude[r],
+                                 &bodies[i * AABB_BATCH + k]);
+        if (x.is_hit && x.time < best.time) {
+          best = x;
+          best_lane = k;
+        }
+      }
+
+      if (h.is_hit != best.is_hit ||
+          (h.is_hit && (h.time != best.time || lane != best_lane ||
+                        !glm_vec3_eqv(h.normal, best.normal) ||
+                        !glm_vec3_eqv(h.pos, best.pos)))) {
+        mismatches++;
+      }
+    }
+  }
+
+  double tests = (double)n_rays * n_boxes;
+  printf("aabbIntersectRay per box  %6.1f M ray-box/s\n",
+         tests / single / 1e6);
+  printf("batched, %-6s kernel     %6.1f M ray-box/s  (%d mismatches)\n",
+         SLAB_KERNEL, tests / batched / 1e6, mismatches);
+
+  free(bodies);
+  free(batches);
+  free(pos);
+  free(magnitude);
+  if (mismatches) exit(1);
+}
+
+Result benchSlab() { return benchIsolated(slabRun, NULL); }
+
+/*
+ * ========
+ * @THREADS
+ * ========
+ *
+ * physicsUpdate on 1, 2, 4 and 8 job threads, for 10k cubes with 5% and with
+ * half of them dynamic. The tick is meant to be bit-identical for any thread
+ * count, so the bodies' position hashes have to agree too.
+ */
+
+typedef struct ThreadsRun {
+  int threads, dynamic;
+  uint64_t* hash;  // shared with the parent
+} ThreadsRun;
+
+static void threadsRun(void* arg) {
+  ThreadsRun* run = arg;
+  jobsInit(run->threads);
+  benchCubes(10000, run->dynamic);
+  physicsUpdate(BENCH_DT);
+
+  int ticks = 30;
+  double t = benchNow();
+  for (int i = 0; i < ticks; i++) physicsUpdate(BENCH_DT);
+  t = benchNow() - t;
+
+  *run->hash = benchBodyHash();
+  printf("%2d%% dynamic  %d threads  %7.3f ms/tick  hash %016" PRIx64 "\n",
+         100 / run->dynamic, run->threads, t / ticks * 1e3, *run->hash);
+  jobsShutdown();
+}
+
+Result benchThreads() {
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  printf("%ld cores online\n", cores);
+  if (cores < 8) {
+    printf("too few cores to show scaling past %ld threads\n", cores);
+  }
+
+  uint64_t* hashes = mmap(NULL, sizeof(uint64_t) * 4, PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (hashes == MAP_FAILED) {
+    perror("mmap");
+    return Err;
+  }
+
+  Result ret = Ok;
+  int dynamic[] = {20, 2};
+  for (int d = 0; d < 2; d++) {
+    for (int i = 0; i < 4; i++) {
+      ThreadsRun run = {1 << i, dynamic[d], &hashes[i]};
+      if (is_err(benchIsolated(threadsRun, &run))) ret = Err;
+    }
+    for (int i = 1; i < 4; i++) {
+      if (hashes[i] != hashes[0]) {
+        fprintf(stderr, "%d threads gave a different result than 1\n", 1 << i);
+        ret = Err;
+      }
+    }
+  }
+
+  munmap(hashes, sizeof(uint64_t) * 4);
+  return ret;
+}
+
+/*
+ * =========
+ * @CONTACTS
+ * =========
+ *
+ * Deleting half of n resting dynamic cubes at once, each delete ending the
+ * contacts of the body it removes.
+ */
+
+static void contactsRun(void* arg) {
+  int n = *(int*)arg;
+  static CubeThing cube = {.color = {1, 1, 1, 1}};
+
+  Body floor = {.pos = {0, 0, 0}, .scale = {200, 1, 200}};
+  thingAdd(thingLoadFromData(&cube, THING_CUBE, &floor));
+  for (int i = 0; i < n; i++) {
+    Body b = {
+        .pos = {(i % 40) * 2.5f - 50, 1.5f + (i / 1600) * 1.2f,
+                ((i / 40) % 40) * 2.5f - 50},
+        .scale = {1, 1, 1},
+        .is_dynamic = true,
+    };
+    thingAdd(thingLoadFromData(&cube, THING_CUBE, &b));
+  }
+  for (int i = 0; i < 120; i++) physicsAdvance(BENCH_DT);
+
+  ThingId* ids = malloc(sizeof(ThingId) * n);
+  for (int i = 0; i < n; i++) ids[i] = THINGS.dense[i + 1]->id;
+
+  double t = benchNow();
+  for (int i = 0; i < n; i += 2) thingDelete(ids[i]);
+  t = benchNow() - t;
+
+  printf("%6d bodies  deleted %6d in %8.2f ms  %zu end events\n", n, n / 2,
+         t * 1e3, PHYSICS.events.n);
+  free(ids);
+}
+
+Result benchContacts() {
+  int sizes[] = {3000, 10000, 20000};
+  for (int i = 0; i < 3; i++) {
+    if (is_err(benchIsolated(contactsRun, &sizes[i]))) return Err;
+  }
+  return Ok;
+}
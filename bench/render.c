@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bench.h"
+#include "glad.h"
+#include "mesh.h"
+#include "thing.h"
+
+/*
+ * =======
+ * @NULLGL
+ * =======
+ *
+ * A GL loader for running render code without a context. It reports GL 3.3,
+ * compiles and links everything, and every program has the uniforms the
+ * built-in shaders use. Everything else does nothing but count the call.
+ */
+
+static long GL_CALLS;
+static long GL_LOCATION_LOOKUPS;
+
+static const char* NULL_UNIFORMS[] = {
+    "model",        "color",        "texture_diffuse1", "texture_specular1",
+    "transforms[0]", "letterMap[0]", "textColor",
+};
+
+#define N_NULL_UNIFORMS \
+  (int)(sizeof(NULL_UNIFORMS) / sizeof(NULL_UNIFORMS[0]))
+
+static unsigned int NULL_NAMES = 1;
+
+static long nullCall() {
+  GL_CALLS++;
+  return 1;
+}
+
+static GLenum nullGetError() { return GL_NO_ERROR; }
+
+static const GLubyte* nullGetString(GLenum name) {
+  return (const GLubyte*)"3.3.0 null";
+}
+
+static const GLubyte* nullGetStringi(GLenum name, GLuint i) {
+  return (const GLubyte*)"GL_null";
+}
+
+static void nullGetIntegerv(GLenum name, GLint* out) { *out = 1; }
+
+static void nullGetiv(GLuint object, GLenum name, GLint* out) {
+  GL_CALLS++;
+  *out = name == GL_ACTIVE_UNIFORMS ? N_NULL_UNIFORMS : 1;
+}
+
+static void nullGen(GLsizei n, GLuint* names) {
+  GL_CALLS++;
+  for (int i = 0; i < n; i++) names[i] = NULL_NAMES++;
+}
+
+static GLuint nullCreate() {
+  GL_CALLS++;
+  return NULL_NAMES++;
+}
+
+static void nullGetActiveUniform(GLuint program, GLuint i, GLsizei size,
+                                 GLsizei* len, GLint* count, GLenum* type,
+                                 GLchar* name) {
+  GL_CALLS++;
+  snprintf(name, size, "%s", NULL_UNIFORMS[i]);
+  if (len) *len = strlen(name);
+  *count = 1;
+  *type = GL_FLOAT;
+}
+
+// location is the index in NULL_UNIFORMS; arrays also answer to their name
+static GLint nullGetUniformLocation(GLuint program, const GLchar* name) {
+  GL_CALLS++;
+  GL_LOCATION_LOOKUPS++;
+  size_t len = strlen(name);
+  for (int i = 0; i < N_NULL_UNIFORMS; i++) {
+    const char* u = NULL_UNIFORMS[i];
+    if (!strncmp(name, u, len) && (!u[len] || !strcmp(u + len, "[0]"))) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static void* nullGLProc(const char* name) {
+  if (!strncmp(name, "glGen", 5) && strcmp(name, "glGenerateMipmap")) {
+    return nullGen;
+  }
+  if (!strcmp(name, "glCreateProgram") || !strcmp(name, "glCreateShader")) {
+    return nullCreate;
+  }
+  if (!strcmp(name, "glGetShaderiv") || !strcmp(name, "glGetProgramiv")) {
+    return nullGetiv;
+  }
+  if (!strcmp(name, "glGetError")) return nullGetError;
+  if (!strcmp(name, "glGetString")) return nullGetString;
+  if (!strcmp(name, "glGetStringi")) return nullGetStringi;
+  if (!strcmp(name, "glGetIntegerv")) return nullGetIntegerv;
+  if (!strcmp(name, "glGetActiveUniform")) return nullGetActiveUniform;
+  if (!strcmp(name, "glGetUniformLocation")) return nullGetUniformLocation;
+  return nullCall;
+}
+
+/*
+ * =========
+ * @UNIFORMS
+ * =========
+ *
+ * GL calls made per frame by 1000 renderCube and 1000 two-texture meshDraw
+ * calls on the null loader, how many of them look up a uniform location, and
+ * the CPU time they take.
+ */
+
+static void uniformsRun(void* arg) {
+  if (!gladLoadGLLoader(nullGLProc)) {
+    fprintf(stderr, "null GL loader failed\n");
+    exit(1);
+  }
+
+  CubeThing cube = {.color = {1, 1, 1, 1}};
+  Body body = {.scale = {1, 1, 1}};
+  Thing* t = thingLoadFromData(&cube, THING_CUBE, &body);
+  RenderInfo cube_ri = t->render.rinit();
+  RenderInfo model_ri = renderInitModel();
+
+  Mesh mesh = {0};
+  kv_push(MeshTexture, mesh.textures, ((MeshTexture){3, T_DIFFUSE}));
+  kv_push(MeshTexture, mesh.textures, ((MeshTexture){4, T_SPECULAR}));
+
+  mat4 proj, view;
+  glm_mat4_identity(proj);
+  glm_mat4_identity(view);
+  RenderMatrices rm = {&proj, &view};
+
+  int frames = 50, per_frame = 1000;
+  long calls = GL_CALLS, lookups = GL_LOCATION_LOOKUPS;
+  double time = benchNow();
+  for (int f = 0; f < frames; f++) {
+    for (int i = 0; i < per_frame; i++) {
+      renderCube(&cube, &body, cube_ri, rm, NULL);
+      meshDraw(&mesh, model_ri.shader);
+    }
+  }
+  time = benchNow() - time;
+
+  printf("%d cubes + %d mesh draws a frame\n", per_frame, per_frame);
+  printf("%8.0f GL calls/frame\n", (GL_CALLS - calls) / (double)frames);
+  printf("%8.0f glGetUniformLocation/frame\n",
+         (GL_LOCATION_LOOKUPS - lookups) / (double)frames);
+  printf("%8.3f ms/frame\n", time / frames * 1e3);
+  kv_destroy(mesh.textures);
+}
+
+Result benchUniforms() { return benchIsolated(uniformsRun, NULL); }
@@ -0,0 +1,92 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bench.h"
+#include "ecs.h"
+#include "scene.h"
+#include "thing.h"
+
+/*
+ * ======
+ * @SCENE
+ * ======
+ *
+ * Saving a scene of 1M things, then loading it into a fresh process: mapping
+ * and checking the file, and adding the things, physics and all.
+ */
+
+#define SCENE_BENCH_THINGS 1000000
+
+static void sceneSaveRun(void* arg) {
+  const char* path = arg;
+  int n = SCENE_BENCH_THINGS;
+  static CubeThing colors[3] = {
+      {.color = {1, 0, 0, 1}},
+      {.color = {0, 1, 0, 1}},
+      {.color = {0, 0, 1, 1}},
+  };
+  srand(4);
+
+  Prefab cubes, triangles, dynamic;
+  Body body = {.scale = {1, 1, 1}};
+  prefabInit(&cubes, &colors[0], THING_CUBE, &body);
+  prefabInit(&triangles, &colors[1], THING_TRIANGLE, &body);
+  body.is_dynamic = true;
+  prefabInit(&dynamic, &colors[2], THING_CUBE, &body);
+
+  Transform* transforms = calloc(n, sizeof(Transform));
+  for (int i = 0; i < n; i++) {
+    transforms[i] = (Transform){
+        .pos = {(i % 1000) * 2.0f, (rand() % 100) * 0.1f, (i / 1000) * 2.0f},
+        .rot = {rand() % 90, 0, 0},
+        .scale = {1 + (rand() % 3) * 0.5f, 1, 1},
+    };
+  }
+  thingSpawnBatch(&cubes, n / 2, transforms, NULL);
+  thingSpawnBatch(&triangles, n / 4, transforms + n / 2, NULL);
+  thingSpawnBatch(&dynamic, n - n / 2 - n / 4, transforms + n / 2 + n / 4,
+                  NULL);
+  free(transforms);
+
+  double t = benchNow();
+  if (is_err(sceneSave(path))) exit(1);
+  t = benchNow() - t;
+
+  struct stat st;
+  stat(path, &st);
+  printf("save  %u things  %5.1f MB  %8.1f ms\n", THINGS.n, st.st_size / 1e6,
+         t * 1e3);
+}
+
+static void sceneLoadRun(void* arg) {
+  Scene scene;
+  double t = benchNow();
+  if (is_err(sceneOpen(&scene, arg))) exit(1);
+  double open = benchNow() - t;
+  if (is_err(sceneAddThings(&scene, NULL))) exit(1);
+  t = benchNow() - t;
+
+  printf("load  %u things  open %.1f ms  total %8.1f ms\n", scene.n_things,
+         open * 1e3, t * 1e3);
+}
+
+Result benchSceneLoad() {
+  char path[] = "/tmp/scene_bench_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    return Err;
+  }
+  close(fd);
+
+  Result ret = benchIsolated(sceneSaveRun, path);
+  // the save leaves the file in the page cache, so these are warm loads
+  for (int i = 0; i < 2 && ret == Ok; i++) {
+    ret = benchIsolated(sceneLoadRun, path);
+  }
+
+  unlink(path);
+  return ret;
+}
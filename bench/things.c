@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bench.h"
+#include "ecs.h"
+#include "thing.h"
+
+/*
+ * ======
+ * @LISTS
+ * ======
+ *
+ * Picking the things the AABB overlay wants out of 100k, 5% of them cubes and
+ * 10% triangles: by scanning every thing, and from the thing manager's lists.
+ */
+
+static void listsRun(void* arg) {
+  int n = 100000, rounds = 200;
+  static CubeThing cube = {.color = {0, 1, 0, 1}};
+  static TriangleThing triangle = {.color = {1, 0, 0, 1}};
+
+  Prefab squares, triangles, cubes;
+  Body body = {.scale = {1, 1, 1}};
+  prefabInit(&squares, &cube, THING_SQUARE, &body);
+  prefabInit(&triangles, &triangle, THING_TRIANGLE, &body);
+  prefabInit(&cubes, &cube, THING_CUBE, &body);
+
+  Transform* transforms = calloc(n, sizeof(Transform));
+  for (int i = 0; i < n; i++) {
+    transforms[i] = (Transform){
+        .pos = {(i % 316) * 3.0f - 474, 0.5f, (i / 316) * 3.0f - 474},
+        .scale = {1, 1, 1},
+    };
+  }
+  int n_cubes = n / 20, n_triangles = n / 10;
+  thingSpawnBatch(&cubes, n_cubes, transforms, NULL);
+  thingSpawnBatch(&triangles, n_triangles, transforms + n_cubes, NULL);
+  thingSpawnBatch(&squares, n - n_cubes - n_triangles,
+                  transforms + n_cubes + n_triangles, NULL);
+
+  // summed so the loops can't be optimized away
+  volatile float sink = 0;
+
+  // triangles and cubes, reading their transforms
+  double t = benchNow();
+  for (int r = 0; r < rounds; r++) {
+    for (uint32_t i = 0; i < THINGS.n; i++) {
+      Thing* thing = THINGS.dense[i];
+      if (thing->type != THING_TRIANGLE && thing->type != THING_CUBE) continue;
+      Transform* tr = ecsGet(COMP_TRANSFORM, THINGS.dense_slot[i]);
+      sink += tr->pos[0];
+    }
+  }
+  double overlay_scan = (benchNow() - t) / rounds;
+
+  int overlay[] = {THING_TRIANGLE, THING_CUBE};
+  t = benchNow();
+  for (int r = 0; r < rounds; r++) {
+    for (int k = 0; k < 2; k++) {
+      ThingList* l = &THINGS.types[overlay[k]];
+      for (uint32_t i = 0; i < l->n; i++) {
+        Transform* tr = ecsGet(COMP_TRANSFORM, l->slots[i]);
+        sink += tr->pos[0];
+      }
+    }
+  }
+  double overlay_list = (benchNow() - t) / rounds;
+
+  printf("overlay things  scan %7.3f ms  list %7.3f ms\n", overlay_scan * 1e3,
+         overlay_list * 1e3);
+  free(transforms);
+}
+
+Result benchLists() { return benchIsolated(listsRun, NULL); }
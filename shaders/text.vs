@@ -1,4 +1,11 @@
 #version 330 core
+layout (std140) uniform Camera {
+    mat4 proj;
+    mat4 view;
+    mat4 viewProj;
+    mat4 ortho;
+    vec3 cameraPos;
+};
 layout (location = 0) in vec2 vertex; // <vec2 pos>
 
 out VS_OUT{
@@ -7,11 +14,10 @@ out VS_OUT{
 }vs_out;
 
 uniform mat4 transforms[64];
-uniform mat4 projection;
 
 void main()
 {
-    gl_Position = projection * transforms[gl_InstanceID]* vec4(vertex.xy, 0.0, 1.0);
+    gl_Position = ortho * transforms[gl_InstanceID]* vec4(vertex.xy, 0.0, 1.0);
     vs_out.index=gl_InstanceID;
     vs_out.TexCoords = vertex.xy;
     vs_out.TexCoords.y=1.0f-vs_out.TexCoords.y;
@@ -0,0 +1,121 @@
+#include "alloc.h"
+#include <stdlib.h>
+#include "log.h"
+
+static inline void statsAdd(AllocStats* s, size_t n) {
+  s->live += n;
+  if (s->live > s->peak) s->peak = s->live;
+}
+
+/*
+ * =====
+ * @POOL
+ * =====
+ */
+
+void poolInit(Pool* p, size_t block_size, int chunk_blocks) {
+  // blocks hold the free list link while unused
+  if (block_size < sizeof(void*)) block_size = sizeof(void*);
+  *p = (Pool)POOL_INIT(block_size, chunk_blocks);
+}
+
+void poolDestroy(Pool* p) {
+  for (int i = 0; i < p->chunks.n; i++) free(p->chunks.a[i]);
+  kv_destroy(p->chunks);
+  *p = (Pool){0};
+}
+
+// Reserve another chunk and thread its blocks onto the free list.
+static void poolGrow(Pool* p) {
+  char* chunk = malloc(p->block_size * p->chunk_blocks);
+  if (!chunk) {
+    log_error("failed to grow pool of %zu byte blocks", p->block_size);
+    exit(1);
+  }
+  kv_push(void*, p->chunks, chunk);
+
+  for (int i = p->chunk_blocks - 1; i >= 0; i--) {
+    void* block = chunk + p->block_size * i;
+    *(void**)block = p->free;
+    p->free = block;
+  }
+  p->stats.capacity += p->chunk_blocks;
+}
+
+void* poolAlloc(Pool* p) {
+  if (!p->free) poolGrow(p);
+
+  void* block = p->free;
+  p->free = *(void**)block;
+  statsAdd(&p->stats, 1);
+  return block;
+}
+
+void poolFree(Pool* p, void* block) {
+  if (!block) return;
+  *(void**)block = p->free;
+  p->free = block;
+  p->stats.live--;
+}
+
+/*
+ * ======
+ * @ARENA
+ * ======
+ */
+
+void arenaInit(Arena* a, size_t chunk_size) {
+  *a = (Arena)ARENA_INIT(chunk_size);
+}
+
+void arenaDestroy(Arena* a) {
+  ArenaChunk* c = a->first;
+  while (c) {
+    ArenaChunk* next = c->next;
+    free(c);
+    c = next;
+  }
+  *a = (Arena){0};
+}
+
+void* arenaAlloc(Arena* a, size_t size) {
+  size = ALLOC_ROUND(size);
+
+  // move on to the next chunk, reusing ones kept by arenaReset
+  while (a->current && a->current->used + size > a->current->size) {
+    if (!a->current->next) break;
+    a->current = a->current->next;
+  }
+
+  ArenaChunk* c = a->current;
+  if (!c || c->used + size > c->size) {
+    size_t n = size > a->chunk_size ? size : a->chunk_size;
+    ArenaChunk* chunk = malloc(sizeof(ArenaChunk) + n);
+    if (!chunk) {
+      log_error("failed to grow arena by %zu bytes", n);
+      exit(1);
+    }
+    *chunk = (ArenaChunk){.size = n};
+
+    if (c) {
+      c->next = chunk;
+    } else {
+      a->first = chunk;
+    }
+    a->current = c = chunk;
+    a->stats.capacity += n;
+  }
+
+  void* ptr = c->data + c->used;
+  c->used += size;
+  statsAdd(&a->stats, size);
+  return ptr;
+}
+
+// Free everything allocated from the arena at once. The chunks are kept for
+// the next round of allocations.
+void arenaReset(Arena* a) {
+  for (ArenaChunk* c = a->first; c; c = c->next) c->used = 0;
+  a->current = a->first;
+  a->stats.live = 0;
+}
@@ -0,0 +1,62 @@
+#ifndef GAME_ALLOC
+#define GAME_ALLOC
+#include <stddef.h>
+#include "kvec.h"
+
+/*
+ * =======
+ * @ALLOC
+ * =======
+ *
+ * Pools hand out fixed-size blocks from big chunks and keep freed blocks on a
+ * free list, so churning objects never goes back to malloc. Arenas hand out
+ * anything by bumping a pointer, and are freed all at once with arenaReset.
+ */
+
+typedef struct AllocStats {
+  size_t live;      // blocks (pools) or bytes (arenas) in use
+  size_t peak;      // most ever live at once
+  size_t capacity;  // blocks or bytes reserved from malloc
+} AllocStats;
+
+// every block and arena allocation is aligned to this
+#define ALLOC_ALIGN 16
+#define ALLOC_ROUND(n) (((n) + ALLOC_ALIGN - 1) & ~(size_t)(ALLOC_ALIGN - 1))
+
+typedef struct Pool {
+  size_t block_size;
+  int chunk_blocks;  // blocks reserved per malloc
+  void* free;        // first free block; each one points to the next
+  kvec_t(void*) chunks;
+  AllocStats stats;
+} Pool;
+
+typedef struct ArenaChunk {
+  struct ArenaChunk* next;
+  size_t size, used;
+  _Alignas(ALLOC_ALIGN) char data[];
+} ArenaChunk;
+
+typedef struct Arena {
+  ArenaChunk* first;
+  ArenaChunk* current;
+  size_t chunk_size;
+  AllocStats stats;
+} Arena;
+
+// Static initializers, for pools and arenas that are used before any init
+// function could run. Blocks must fit a pointer.
+#define POOL_INIT(size, blocks) \
+  {.block_size = ALLOC_ROUND(size), .chunk_blocks = (blocks)}
+#define ARENA_INIT(size) {.chunk_size = (size)}
+
+void poolInit(Pool* p, size_t block_size, int chunk_blocks);
+void poolDestroy(Pool* p);
+void* poolAlloc(Pool* p);
+void poolFree(Pool* p, void* block);
+
+void arenaInit(Arena* a, size_t chunk_size);
+void arenaDestroy(Arena* a);
+void* arenaAlloc(Arena* a, size_t size);
+void arenaReset(Arena* a);
+#endif
@@ -0,0 +1,746 @@
+#include <float.h>
+#include <string.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "bvh.h"
+#include "log.h"
+#include "utils.h"
+
+static inline bool bvhIsLeaf(BvhNode* n) { return n->left == BVH_NULL; }
+
+static inline float boxArea(vec3 min, vec3 max) {
+  float dx = max[0] - min[0], dy = max[1] - min[1], dz = max[2] - min[2];
+  return 2.0f * (dx * dy + dy * dz + dz * dx);
+}
+
+static inline void boxUnion(vec3 amin, vec3 amax, vec3 bmin, vec3 bmax,
+                            vec3 min, vec3 max) {
+  for (int i = 0; i < 3; i++) {
+    min[i] = MIN(amin[i], bmin[i]);
+    max[i] = MAX(amax[i], bmax[i]);
+  }
+}
+
+static inline float boxUnionArea(vec3 amin, vec3 amax, vec3 bmin, vec3 bmax) {
+  vec3 min, max;
+  boxUnion(amin, amax, bmin, bmax, min, max);
+  return boxArea(min, max);
+}
+
+// does a contain b?
+static inline bool boxContains(vec3 amin, vec3 amax, vec3 bmin, vec3 bmax) {
+  return amin[0] <= bmin[0] && amin[1] <= bmin[1] && amin[2] <= bmin[2] &&
+         amax[0] >= bmax[0] && amax[1] >= bmax[1] && amax[2] >= bmax[2];
+}
+
+static inline bool boxOverlap(vec3 amin, vec3 amax, vec3 bmin, vec3 bmax) {
+  return amin[0] <= bmax[0] && amax[0] >= bmin[0] && amin[1] <= bmax[1] &&
+         amax[1] >= bmin[1] && amin[2] <= bmax[2] && amax[2] >= bmin[2];
+}
+
+// Traversal stack for queries. It lives on the C stack so concurrent queries
+// never share scratch space, and only moves to the heap for very deep trees.
+#define BVH_STACK_SIZE 128
+
+typedef struct BvhStack {
+  int local[BVH_STACK_SIZE];
+  int* a;
+  int n, m;
+} BvhStack;
+
+static inline void bvhStackInit(BvhStack* s) {
+  s->a = s->local;
+  s->n = 0;
+  s->m = BVH_STACK_SIZE;
+}
+
+static inline void bvhStackPush(BvhStack* s, int v) {
+  if (s->n == s->m) {
+    s->m *= 2;
+    if (s->a == s->local) {
+      s->a = malloc(sizeof(int) * s->m);
+      memcpy(s->a, s->local, sizeof(s->local));
+    } else {
+      s->a = realloc(s->a, sizeof(int) * s->m);
+    }
+  }
+  s->a[s->n++] = v;
+}
+
+static inline void bvhStackFree(BvhStack* s) {
+  if (s->a != s->local) free(s->a);
+}
+
+// Grow box by the fat margin, and stretch it along displacement.
+static void bvhFatten(vec3 min, vec3 max, vec3 displacement, vec3 fmin,
+                      vec3 fmax) {
+  for (int i = 0; i < 3; i++) {
+    float d = displacement[i] * BVH_DISPLACEMENT_MULTIPLIER;
+    fmin[i] = min[i] - BVH_FAT_MARGIN + fminf(d, 0);
+    fmax[i] = max[i] + BVH_FAT_MARGIN + fmaxf(d, 0);
+  }
+}
+
+void bvhInit(Bvh* t) {
+  t->root = BVH_NULL;
+  t->count = 0;
+  t->capacity = 0;
+  t->free = BVH_NULL;
+  t->nodes = NULL;
+  kv_init(t->stack);
+  kv_init(t->costs);
+}
+
+void bvhDestroy(Bvh* t) {
+  free(t->nodes);
+  kv_destroy(t->stack);
+  kv_destroy(t->costs);
+  bvhInit(t);
+}
+
+// Make room for at least capacity nodes, putting the new ones on the free
+// list.
+static void bvhGrow(Bvh* t, int capacity) {
+  int old = t->capacity;
+  if (capacity <= old) return;
+
+  BvhNode* nodes = realloc(t->nodes, sizeof(BvhNode) * capacity);
+  if (!nodes) {
+    log_error("failed to grow bvh to %d nodes", capacity);
+    exit(1);
+  }
+  t->nodes = nodes;
+
+  for (int i = old; i < capacity; i++) {
+    t->nodes[i].parent = i + 1 < capacity ? i + 1 : t->free;
+    t->nodes[i].height = -1;
+  }
+  t->free = old;
+  t->capacity = capacity;
+}
+
+static int bvhAllocNode(Bvh* t) {
+  if (t->free == BVH_NULL) bvhGrow(t, t->capacity ? t->capacity * 2 : 64);
+
+  int id = t->free;
+  BvhNode* n = &t->nodes[id];
+  t->free = n->parent;
+
+  n->parent = n->left = n->right = BVH_NULL;
+  n->height = 0;
+  n->data = NULL;
+  t->count++;
+  return id;
+}
+
+static void bvhFreeNode(Bvh* t, int id) {
+  t->nodes[id].parent = t->free;
+  t->nodes[id].height = -1;
+  t->free = id;
+  t->count--;
+}
+
+static void bvhRefit(Bvh* t, int id) {
+  BvhNode* n = &t->nodes[id];
+  BvhNode* l = &t->nodes[n->left];
+  BvhNode* r = &t->nodes[n->right];
+  boxUnion(l->min, l->max, r->min, r->max, n->min, n->max);
+  n->height = 1 + (l->height > r->height ? l->height : r->height);
+}
+
+// Swap one of iA's children with a grandchild on the other side if that
+// shrinks the surface area of the subtree it lands in.
+static void bvhRotate(Bvh* t, int iA) {
+  BvhNode* A = &t->nodes[iA];
+  if (A->height < 2) return;
+
+  int iB = A->left, iC = A->right;
+  BvhNode* B = &t->nodes[iB];
+  BvhNode* C = &t->nodes[iC];
+
+  // candidate swaps: B with F or G (C's children), C with D or E (B's).
+  enum { R_NONE, R_BF, R_BG, R_CD, R_CE } rot = R_NONE;
+  float best = 0.0f, cost;
+
+  if (!bvhIsLeaf(C)) {
+    BvhNode* F = &t->nodes[C->left];
+    BvhNode* G = &t->nodes[C->right];
+    float area = boxArea(C->min, C->max);
+
+    if ((cost = boxUnionArea(B->min, B->max, G->min, G->max) - area) < best) {
+      best = cost;
+      rot = R_BF;
+    }
+    if ((cost = boxUnionArea(B->min, B->max, F->min, F->max) - area) < best) {
+      best = cost;
+      rot = R_BG;
+    }
+  }
+
+  if (!bvhIsLeaf(B)) {
+    BvhNode* D = &t->nodes[B->left];
+    BvhNode* E = &t->nodes[B->right];
+    float area = boxArea(B->min, B->max);
+
+    if ((cost = boxUnionArea(C->min, C->max, E->min, E->max) - area) < best) {
+      best = cost;
+      rot = R_CD;
+    }
+    if ((cost = boxUnionArea(C->min, C->max, D->min, D->max) - area) < best) {
+      best = cost;
+      rot = R_CE;
+    }
+  }
+
+  int moved;
+  switch (rot) {
+    case R_BF:
+      moved = C->left;
+      C->left = iB;
+      B->parent = iC;
+      A->left = moved;
+      t->nodes[moved].parent = iA;
+      bvhRefit(t, iC);
+      break;
+    case R_BG:
+      moved = C->right;
+      C->right = iB;
+      B->parent = iC;
+      A->left = moved;
+      t->nodes[moved].parent = iA;
+      bvhRefit(t, iC);
+      break;
+    case R_CD:
+      moved = B->left;
+      B->left = iC;
+      C->parent = iB;
+      A->right = moved;
+      t->nodes[moved].parent = iA;
+      bvhRefit(t, iB);
+      break;
+    case R_CE:
+      moved = B->right;
+      B->right = iC;
+      C->parent = iB;
+      A->right = moved;
+      t->nodes[moved].parent = iA;
+      bvhRefit(t, iB);
+      break;
+    default:
+      return;
+  }
+
+  bvhRefit(t, iA);
+}
+
+// Refit and rotate every ancestor of id.
+static void bvhFixUpwards(Bvh* t, int id) {
+  while (id != BVH_NULL) {
+    bvhRefit(t, id);
+    bvhRotate(t, id);
+    id = t->nodes[id].parent;
+  }
+}
+
+static void bvhInsertLeaf(Bvh* t, int leaf) {
+  if (t->root == BVH_NULL) {
+    t->root = leaf;
+    t->nodes[leaf].parent = BVH_NULL;
+    return;
+  }
+
+  vec3 lmin, lmax;
+  glm_vec3_copy(t->nodes[leaf].min, lmin);
+  glm_vec3_copy(t->nodes[leaf].max, lmax);
+
+  // Branch and bound search for the sibling that adds the least surface area
+  // to the tree: the new parent's area plus the growth of every ancestor.
+  float leaf_area = boxArea(lmin, lmax);
+  int index = t->root;
+  float best = boxUnionArea(t->nodes[index].min, t->nodes[index].max, lmin,
+                            lmax);
+
+  t->stack.n = t->costs.n = 0;
+  kv_push(int, t->stack, t->root);
+  kv_push(float, t->costs, 0.0f);
+
+  while (t->stack.n) {
+    int id = kv_pop(t->stack);
+    float inherit = kv_pop(t->costs);
+    BvhNode* n = &t->nodes[id];
+
+    float direct = boxUnionArea(n->min, n->max, lmin, lmax);
+    if (direct + inherit < best) {
+      best = direct + inherit;
+      index = id;
+    }
+
+    if (bvhIsLeaf(n)) continue;
+
+    inherit += direct - boxArea(n->min, n->max);
+    if (leaf_area + inherit >= best) continue;
+
+    kv_push(int, t->stack, n->left);
+    kv_push(float, t->costs, inherit);
+    kv_push(int, t->stack, n->right);
+    kv_push(float, t->costs, inherit);
+  }
+
+  int sibling = index;
+  int old_parent = t->nodes[sibling].parent;
+  int new_parent = bvhAllocNode(t);
+
+  BvhNode* p = &t->nodes[new_parent];
+  p->parent = old_parent;
+  p->left = sibling;
+  p->right = leaf;
+  t->nodes[sibling].parent = new_parent;
+  t->nodes[leaf].parent = new_parent;
+
+  if (old_parent != BVH_NULL) {
+    if (t->nodes[old_parent].left == sibling) {
+      t->nodes[old_parent].left = new_parent;
+    } else {
+      t->nodes[old_parent].right = new_parent;
+    }
+  } else {
+    t->root = new_parent;
+  }
+
+  bvhFixUpwards(t, new_parent);
+}
+
+// Leaf and the Morton code of its box centre, for bvhBuild.
+typedef struct BvhBuildItem {
+  uint32_t code;
+  int leaf;
+} BvhBuildItem;
+
+// Spread the low 10 bits of v out to every third bit.
+static inline uint32_t mortonSpread(uint32_t v) {
+  v = (v * 0x00010001u) & 0xFF0000FFu;
+  v = (v * 0x00000101u) & 0x0F00F00Fu;
+  v = (v * 0x00000011u) & 0xC30C30C3u;
+  v = (v * 0x00000005u) & 0x49249249u;
+  return v;
+}
+
+// Sort items by code, one byte at a time. tmp must hold n items.
+static void bvhSortItems(BvhBuildItem* items, BvhBuildItem* tmp, int n) {
+  for (int shift = 0; shift < 32; shift += 8) {
+    int count[257] = {0};
+    for (int i = 0; i < n; i++) count[((items[i].code >> shift) & 0xff) + 1]++;
+    for (int i = 0; i < 256; i++) count[i + 1] += count[i];
+    for (int i = 0; i < n; i++) {
+      tmp[count[(items[i].code >> shift) & 0xff]++] = items[i];
+    }
+
+    BvhBuildItem* swap = items;
+    items = tmp;
+    tmp = swap;
+  }
+  // four passes, so the sorted items ended up back where they started
+}
+
+// Where to split sorted items: after the last one that still agrees with the
+// first on the highest bit where the first and last differ, so each half
+// covers its own region of space.
+static int bvhSplit(BvhBuildItem* items, int n) {
+  uint32_t first = items[0].code, last = items[n - 1].code;
+  if (first == last) return n / 2;
+
+  int prefix = __builtin_clz(first ^ last);
+  int lo = 0, hi = n - 1;  // items[lo] agrees, items[hi] doesn't
+  while (hi - lo > 1) {
+    int mid = (lo + hi) / 2;
+    uint32_t diff = first ^ items[mid].code;
+    if (!diff || __builtin_clz(diff) > prefix) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+  return hi;
+}
+
+// Build a subtree over items sorted along the Morton curve, splitting them
+// where their codes first differ until single leaves are left. Returns its
+// root.
+static int bvhBuild(Bvh* t, BvhBuildItem* items, int n) {
+  if (n == 1) return items[0].leaf;
+
+  int mid = bvhSplit(items, n);
+  int left = bvhBuild(t, items, mid);
+  int right = bvhBuild(t, items + mid, n - mid);
+
+  int id = bvhAllocNode(t);
+  t->nodes[id].left = left;
+  t->nodes[id].right = right;
+  t->nodes[left].parent = id;
+  t->nodes[right].parent = id;
+  bvhRefit(t, id);
+  return id;
+}
+
+// Insert n boxes at once: build a subtree over them, then insert that like a
+// single leaf. Much faster than n calls to bvhInsert, at the cost of a
+// somewhat worse tree where the new boxes overlap old ones. The new leaves
+// are written to out.
+void bvhInsertBatch(Bvh* t, int n, vec3* mins, vec3* maxs, void** data,
+                    int* out) {
+  if (n <= 0) return;
+
+  BvhBuildItem* items = malloc(sizeof(BvhBuildItem) * n * 2);
+  if (!items) {
+    log_error("failed to allocate %d bvh leaves", n);
+    exit(1);
+  }
+
+  // n leaves and n - 1 nodes above them
+  if (t->count + 2 * n > t->capacity) {
+    bvhGrow(t, MAX(t->capacity * 2, t->count + 2 * n));
+  }
+
+  vec3 cmin = {FLT_MAX, FLT_MAX, FLT_MAX};
+  vec3 cmax = {-FLT_MAX, -FLT_MAX, -FLT_MAX};
+  for (int i = 0; i < n; i++) {
+    int leaf = bvhAllocNode(t);
+    BvhNode* node = &t->nodes[leaf];
+    bvhFatten(mins[i], maxs[i], (vec3){0, 0, 0}, node->min, node->max);
+    node->data = data[i];
+    out[i] = leaf;
+
+    for (int a = 0; a < 3; a++) {
+      float c = mins[i][a] + maxs[i][a];
+      cmin[a] = MIN(cmin[a], c);
+      cmax[a] = MAX(cmax[a], c);
+    }
+  }
+
+  // 10 bits per axis across the cube around every centre, the same scale on
+  // every axis so flat levels still get split along their long sides first
+  float extent =
+      MAX(cmax[0] - cmin[0], MAX(cmax[1] - cmin[1], cmax[2] - cmin[2]));
+  float scale = extent > 0 ? 1023.0f / extent : 0;
+  for (int i = 0; i < n; i++) {
+    uint32_t code = 0;
+    for (int a = 0; a < 3; a++) {
+      float c = (mins[i][a] + maxs[i][a] - cmin[a]) * scale;
+      code |= mortonSpread((uint32_t)MIN(c, 1023.0f)) << (2 - a);
+    }
+    items[i] = (BvhBuildItem){.code = code, .leaf = out[i]};
+  }
+
+  bvhSortItems(items, items + n, n);
+  bvhInsertLeaf(t, bvhBuild(t, items, n));
+  free(items);
+}
+
+static void bvhRemoveLeaf(Bvh* t, int leaf) {
+  if (leaf == t->root) {
+    t->root = BVH_NULL;
+    return;
+  }
+
+  int parent = t->nodes[leaf].parent;
+  int grandparent = t->nodes[parent].parent;
+  int sibling = t->nodes[parent].left == leaf ? t->nodes[parent].right
+                                              : t->nodes[parent].left;
+
+  if (grandparent != BVH_NULL) {
+    if (t->nodes[grandparent].left == parent) {
+      t->nodes[grandparent].left = sibling;
+    } else {
+      t->nodes[grandparent].right = sibling;
+    }
+    t->nodes[sibling].parent = grandparent;
+    bvhFreeNode(t, parent);
+    bvhFixUpwards(t, grandparent);
+  } else {
+    t->root = sibling;
+    t->nodes[sibling].parent = BVH_NULL;
+    bvhFreeNode(t, parent);
+  }
+}
+
+// Insert a leaf for the box [min, max]. Returns the leaf's id, which stays
+// valid until it is removed.
+int bvhInsert(Bvh* t, vec3 min, vec3 max, void* data) {
+  int leaf = bvhAllocNode(t);
+  BvhNode* n = &t->nodes[leaf];
+
+  bvhFatten(min, max, (vec3){0, 0, 0}, n->min, n->max);
+  n->data = data;
+  n->height = 0;
+
+  bvhInsertLeaf(t, leaf);
+  return leaf;
+}
+
+void bvhRemove(Bvh* t, int leaf) {
+  bvhRemoveLeaf(t, leaf);
+  bvhFreeNode(t, leaf);
+}
+
+// Update a leaf's box. The tree is only touched if the box has left its fat
+// box, or the fat box has grown far larger than it needs to be. Returns true if
+// the leaf was reinserted.
+bool bvhMove(Bvh* t, int leaf, vec3 min, vec3 max, vec3 displacement) {
+  BvhNode* n = &t->nodes[leaf];
+  vec3 fmin, fmax, hmin, hmax;
+
+  bvhFatten(min, max, displacement, fmin, fmax);
+
+  if (boxContains(n->min, n->max, min, max)) {
+    glm_vec3_sub(fmin, (vec3){4 * BVH_FAT_MARGIN, 4 * BVH_FAT_MARGIN,
+                              4 * BVH_FAT_MARGIN},
+                 hmin);
+    glm_vec3_add(fmax, (vec3){4 * BVH_FAT_MARGIN, 4 * BVH_FAT_MARGIN,
+                              4 * BVH_FAT_MARGIN},
+                 hmax);
+    if (boxContains(hmin, hmax, n->min, n->max)) return false;
+  }
+
+  bvhRemoveLeaf(t, leaf);
+  glm_vec3_copy(fmin, n->min);
+  glm_vec3_copy(fmax, n->max);
+  bvhInsertLeaf(t, leaf);
+
+  return true;
+}
+
+// Give a leaf exactly this fat box, e.g. to put back a saved state. Queries
+// see fat boxes, so they have to match for the same answers.
+void bvhSetFatBox(Bvh* t, int leaf, vec3 fmin, vec3 fmax) {
+  BvhNode* n = &t->nodes[leaf];
+  if (!memcmp(n->min, fmin, sizeof(vec3)) &&
+      !memcmp(n->max, fmax, sizeof(vec3))) {
+    return;
+  }
+
+  bvhRemoveLeaf(t, leaf);
+  glm_vec3_copy(fmin, n->min);
+  glm_vec3_copy(fmax, n->max);
+  bvhInsertLeaf(t, leaf);
+}
+
+// Queries only read the tree, so any number may run at once as long as
+// nothing is inserted, moved or removed meanwhile.
+void bvhQueryAABB(Bvh* t, vec3 min, vec3 max, BvhQueryFunc f, void* ctx) {
+  if (t->root == BVH_NULL) return;
+
+  BvhStack stack;
+  bvhStackInit(&stack);
+  bvhStackPush(&stack, t->root);
+
+  while (stack.n) {
+    BvhNode* n = &t->nodes[stack.a[--stack.n]];
+    if (!boxOverlap(n->min, n->max, min, max)) continue;
+
+    if (bvhIsLeaf(n)) {
+      if (!f(ctx, n - t->nodes, n->data)) break;
+    } else {
+      bvhStackPush(&stack, n->left);
+      bvhStackPush(&stack, n->right);
+    }
+  }
+
+  bvhStackFree(&stack);
+}
+
+// Walk every leaf hit by the ray pos + magnitude * t, t in [0, tmax], with each
+// node box grown by pad on every side.
+void bvhQueryRay(Bvh* t, vec3 pos, vec3 magnitude, vec3 pad, float tmax,
+                 BvhRayFunc f, void* ctx) {
+  if (t->root == BVH_NULL) return;
+
+  // Fold pad into the origin rather than growing every node:
+  // (min - pad) - pos == min - (pos + pad).
+  vec3 inv, omin, omax;
+  for (int i = 0; i < 3; i++) {
+    inv[i] = fabsf(magnitude[i]) > 1e-8f ? 1.0f / magnitude[i] : 1e30f;
+    omin[i] = pos[i] + pad[i];
+    omax[i] = pos[i] - pad[i];
+  }
+
+  BvhStack stack;
+  bvhStackInit(&stack);
+  bvhStackPush(&stack, t->root);
+
+  while (stack.n) {
+    BvhNode* n = &t->nodes[stack.a[--stack.n]];
+
+    // slab test against the padded node box
+    float tmin = 0.0f, tfar = tmax;
+    for (int i = 0; i < 3; i++) {
+      float t1 = (n->min[i] - omin[i]) * inv[i];
+      float t2 = (n->max[i] - omax[i]) * inv[i];
+      // MIN/MAX rather than fminf/fmaxf: these compile to single
+      // instructions instead of libm calls
+      tmin = MAX(tmin, MIN(t1, t2));
+      tfar = MIN(tfar, MAX(t1, t2));
+    }
+    if (tmin > tfar) continue;
+
+    if (bvhIsLeaf(n)) {
+      float clip = f(ctx, n - t->nodes, n->data, tmax);
+      if (clip <= 0.0f) break;
+      tmax = fminf(tmax, clip);
+    } else {
+      // misses on node loads dominate long rays; start them early
+      __builtin_prefetch(&t->nodes[n->left]);
+      __builtin_prefetch(&t->nodes[n->right]);
+      bvhStackPush(&stack, n->left);
+      bvhStackPush(&stack, n->right);
+    }
+  }
+
+  bvhStackFree(&stack);
+}
+
+/*
+ * ========
+ * @FRUSTUM
+ * ========
+ */
+
+// Planes of the frustum a view-projection matrix sees, each row combination
+// being one side of the clip cube (Gribb & Hartmann).
+void frustumFromMatrix(Frustum* fr, mat4 m) {
+  // cglm is column major: row i is m[0][i], m[1][i], m[2][i], m[3][i]
+  for (int p = 0; p < 6; p++) {
+    int row = p / 2;
+    float sign = p % 2 ? -1.0f : 1.0f;
+    float n[4];
+    for (int i = 0; i < 4; i++) n[i] = m[i][3] + sign * m[i][row];
+
+    float len = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len > 1e-8f) {
+      for (int i = 0; i < 4; i++) n[i] /= len;
+    }
+    fr->nx[p] = n[0];
+    fr->ny[p] = n[1];
+    fr->nz[p] = n[2];
+    fr->d[p] = n[3];
+  }
+
+  for (int p = 6; p < FRUSTUM_PLANES; p++) {
+    fr->nx[p] = fr->ny[p] = fr->nz[p] = 0.0f;
+    fr->d[p] = 1.0f;
+  }
+  for (int p = 0; p < FRUSTUM_PLANES; p++) {
+    fr->ax[p] = fabsf(fr->nx[p]);
+    fr->ay[p] = fabsf(fr->ny[p]);
+    fr->az[p] = fabsf(fr->nz[p]);
+  }
+}
+
+/*
+ * Where a box is against every plane at once. The box is its center c and
+ * extent e: against a plane it reaches from n . c + d - |n| . e to
+ * n . c + d + |n| . e, so it's outside when the top of that is behind any
+ * plane, and inside when the bottom is in front of all of them.
+ */
+
+#if defined(__AVX2__)
+int frustumTestBox(Frustum* fr, vec3 min, vec3 max) {
+  __m256 half = _mm256_set1_ps(0.5f);
+  __m256 dist = _mm256_loadu_ps(fr->d), radius = _mm256_setzero_ps();
+  float* ns[3] = {fr->nx, fr->ny, fr->nz};
+  float* as[3] = {fr->ax, fr->ay, fr->az};
+
+  for (int i = 0; i < 3; i++) {
+    __m256 lo = _mm256_set1_ps(min[i]), hi = _mm256_set1_ps(max[i]);
+    __m256 c = _mm256_mul_ps(_mm256_add_ps(lo, hi), half);
+    __m256 e = _mm256_mul_ps(_mm256_sub_ps(hi, lo), half);
+    dist = _mm256_add_ps(dist, _mm256_mul_ps(_mm256_loadu_ps(ns[i]), c));
+    radius = _mm256_add_ps(radius, _mm256_mul_ps(_mm256_loadu_ps(as[i]), e));
+  }
+
+  __m256 zero = _mm256_setzero_ps();
+  if (_mm256_movemask_ps(
+          _mm256_cmp_ps(_mm256_add_ps(dist, radius), zero, _CMP_LT_OQ))) {
+    return FRUSTUM_OUTSIDE;
+  }
+  if (_mm256_movemask_ps(
+          _mm256_cmp_ps(_mm256_sub_ps(dist, radius), zero, _CMP_LT_OQ))) {
+    return FRUSTUM_INTERSECT;
+  }
+  return FRUSTUM_INSIDE;
+}
+#elif defined(__SSE2__)
+int frustumTestBox(Frustum* fr, vec3 min, vec3 max) {
+  __m128 half = _mm_set1_ps(0.5f), zero = _mm_setzero_ps();
+  float* ns[3] = {fr->nx, fr->ny, fr->nz};
+  float* as[3] = {fr->ax, fr->ay, fr->az};
+  int outside = 0, cut = 0;
+
+  for (int off = 0; off < FRUSTUM_PLANES; off += 4) {
+    __m128 dist = _mm_loadu_ps(fr->d + off), radius = _mm_setzero_ps();
+    for (int i = 0; i < 3; i++) {
+      __m128 lo = _mm_set1_ps(min[i]), hi = _mm_set1_ps(max[i]);
+      __m128 c = _mm_mul_ps(_mm_add_ps(lo, hi), half);
+      __m128 e = _mm_mul_ps(_mm_sub_ps(hi, lo), half);
+      dist = _mm_add_ps(dist, _mm_mul_ps(_mm_loadu_ps(ns[i] + off), c));
+      radius = _mm_add_ps(radius, _mm_mul_ps(_mm_loadu_ps(as[i] + off), e));
+    }
+    outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(dist, radius), zero));
+    cut |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(dist, radius), zero));
+  }
+
+  if (outside) return FRUSTUM_OUTSIDE;
+  return cut ? FRUSTUM_INTERSECT : FRUSTUM_INSIDE;
+}
+#else
+int frustumTestBox(Frustum* fr, vec3 min, vec3 max) {
+  int result = FRUSTUM_INSIDE;
+  for (int p = 0; p < FRUSTUM_PLANES; p++) {
+    float dist = fr->d[p], radius = 0.0f;
+    float n[3] = {fr->nx[p], fr->ny[p], fr->nz[p]};
+    float a[3] = {fr->ax[p], fr->ay[p], fr->az[p]};
+    for (int i = 0; i < 3; i++) {
+      dist += n[i] * ((min[i] + max[i]) * 0.5f);
+      radius += a[i] * ((max[i] - min[i]) * 0.5f);
+    }
+
+    if (dist + radius < 0.0f) return FRUSTUM_OUTSIDE;
+    if (dist - radius < 0.0f) result = FRUSTUM_INTERSECT;
+  }
+  return result;
+}
+#endif
+
+// Walk every leaf whose box is at least partly inside the frustum. Once a
+// node is wholly inside, its subtree is reported without testing any more
+// boxes; those nodes are pushed as ~node.
+void bvhQueryFrustum(Bvh* t, Frustum* fr, BvhQueryFunc f, void* ctx) {
+  if (t->root == BVH_NULL) return;
+
+  BvhStack stack;
+  bvhStackInit(&stack);
+  bvhStackPush(&stack, t->root);
+
+  while (stack.n) {
+    int i = stack.a[--stack.n];
+    bool inside = i < 0;
+    BvhNode* n = &t->nodes[inside ? ~i : i];
+
+    if (!inside) {
+      int test = frustumTestBox(fr, n->min, n->max);
+      if (test == FRUSTUM_OUTSIDE) continue;
+      inside = test == FRUSTUM_INSIDE;
+    }
+
+    if (bvhIsLeaf(n)) {
+      if (!f(ctx, n - t->nodes, n->data)) break;
+    } else {
+      bvhStackPush(&stack, inside ? ~n->left : n->left);
+      bvhStackPush(&stack, inside ? ~n->right : n->right);
+    }
+  }
+
+  bvhStackFree(&stack);
+}
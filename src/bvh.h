@@ -0,0 +1,82 @@
+#ifndef GAME_BVH
+#define GAME_BVH
+#include <stdbool.h>
+#include "cglm/cglm.h"
+#include "kvec.h"
+
+/*
+ * =====
+ * @BVH
+ * =====
+ *
+ * Dynamic AABB tree. Leaves store a fattened copy of the box they were given,
+ * so a body only needs to be reinserted once it leaves its fat box.
+ */
+
+#define BVH_NULL -1
+
+// extra space added around every leaf box
+#define BVH_FAT_MARGIN 0.1f
+
+// how far along its displacement a moving leaf's fat box is stretched
+#define BVH_DISPLACEMENT_MULTIPLIER 4.0f
+
+typedef struct BvhNode {
+  vec3 min, max;
+  void* data;  // leaves only
+  int parent;  // next free node when unused
+  int left, right;
+  int height;  // 0 for leaves, -1 for free nodes
+} BvhNode;
+
+typedef struct Bvh {
+  BvhNode* nodes;
+  int root;
+  int count, capacity;
+  int free;
+  kvec_t(int) stack;    // insertion scratch
+  kvec_t(float) costs;
+} Bvh;
+
+// Called for each leaf the ray reaches. Return the new max ray time to clip
+// the remaining traversal, the passed tmax to keep going, or 0 to stop.
+typedef float (*BvhRayFunc)(void* ctx, int leaf, void* data, float tmax);
+
+// Called for each leaf overlapping the query box. Return false to stop.
+typedef bool (*BvhQueryFunc)(void* ctx, int leaf, void* data);
+
+// planes in a Frustum, the 6 real ones padded with planes nothing is behind
+#define FRUSTUM_PLANES 8
+
+enum FrustumTest {
+  FRUSTUM_OUTSIDE,
+  FRUSTUM_INTERSECT,
+  FRUSTUM_INSIDE,
+};
+
+// Planes facing in, n . p + d >= 0 inside, laid out so each part of every
+// plane loads in one go. a* are the normals' absolute values.
+typedef struct Frustum {
+  float nx[FRUSTUM_PLANES], ny[FRUSTUM_PLANES], nz[FRUSTUM_PLANES];
+  float d[FRUSTUM_PLANES];
+  float ax[FRUSTUM_PLANES], ay[FRUSTUM_PLANES], az[FRUSTUM_PLANES];
+} Frustum;
+
+void bvhInit(Bvh* t);
+void bvhDestroy(Bvh* t);
+
+int bvhInsert(Bvh* t, vec3 min, vec3 max, void* data);
+void bvhInsertBatch(Bvh* t, int n, vec3* mins, vec3* maxs, void** data,
+                    int* out);
+void bvhRemove(Bvh* t, int leaf);
+bool bvhMove(Bvh* t, int leaf, vec3 min, vec3 max, vec3 displacement);
+void bvhSetFatBox(Bvh* t, int leaf, vec3 fmin, vec3 fmax);
+
+void bvhQueryAABB(Bvh* t, vec3 min, vec3 max, BvhQueryFunc f, void* ctx);
+void bvhQueryRay(Bvh* t, vec3 pos, vec3 magnitude, vec3 pad, float tmax,
+                 BvhRayFunc f, void* ctx);
+void bvhQueryFrustum(Bvh* t, Frustum* fr, BvhQueryFunc f, void* ctx);
+
+void frustumFromMatrix(Frustum* fr, mat4 m);
+int frustumTestBox(Frustum* fr, vec3 min, vec3 max);
+#endif
@@ -0,0 +1,90 @@
+#include "commands.h"
+#include <string.h>
+#include "log.h"
+#include "physics.h"
+
+Commands COMMANDS = {0};
+
+static inline void cmdPush(Command* c) {
+  kv_push(Command, COMMANDS.buffers[jobsThreadIndex()].cmds, *c);
+}
+
+// Spawn a copy of like at body. like has to outlive the next flush, and should
+// have been through rendererAddThing already if it is drawn.
+void cmdSpawn(const Thing* like, Body* body) {
+  Command c = {.type = CMD_SPAWN, .spawn = {.like = like, .body = *body}};
+  cmdPush(&c);
+}
+
+void cmdDestroy(ThingId id) {
+  cmdPush(&(Command){.type = CMD_DESTROY, .id = id});
+}
+
+void cmdAddComponent(ThingId id, int comp, const void* data) {
+  Command c = {.type = CMD_ADD_COMPONENT, .id = id, .comp = comp};
+  memcpy(&c.data, data, ECS.sets[comp].size);
+  cmdPush(&c);
+}
+
+void cmdRemoveComponent(ThingId id, int comp) {
+  cmdPush(&(Command){.type = CMD_REMOVE_COMPONENT, .id = id, .comp = comp});
+}
+
+// physics keeps a copy of these, see physicsPushBody
+static inline bool isBodyComponent(int comp) {
+  return comp == COMP_TRANSFORM || comp == COMP_VELOCITY ||
+         comp == COMP_COLLIDER;
+}
+
+static void cmdApply(Command* c) {
+  Thing* t;
+
+  switch (c->type) {
+    case CMD_SPAWN:
+      if ((t = thingClone(c->spawn.like, &c->spawn.body))) thingAdd(t);
+      return;
+    case CMD_DESTROY:
+      // destroying something twice in a frame is fine
+      if (thingGet(c->id)) thingDelete(c->id);
+      return;
+  }
+
+  if (!(t = thingGet(c->id))) return;
+  Entity e = THING_INDEX(c->id);
+
+  if (c->type == CMD_ADD_COMPONENT) {
+    memcpy(ecsAdd(c->comp, e), &c->data, ECS.sets[c->comp].size);
+    if (isBodyComponent(c->comp)) {
+      if (t->proxy != BVH_NULL) {
+        physicsPushBody(t);
+      } else if (ecsGet(COMP_TRANSFORM, e) && ecsGet(COMP_VELOCITY, e) &&
+                 ecsGet(COMP_COLLIDER, e)) {
+        // the last missing part of its body is back
+        physicsAddThing(t);
+      }
+    }
+  } else {
+    // a body without all of its components can't be simulated
+    if (isBodyComponent(c->comp)) physicsRemoveThing(t);
+    ecsRemove(c->comp, e);
+  }
+}
+
+// Apply everything recorded since the last flush. Must not run while anything
+// iterates things or components, or while jobs are running. Returns the
+// number of commands applied.
+int commandsFlush() {
+  int applied = 0;
+
+  for (int b = 0; b < JOBS_MAX_THREADS; b++) {
+    CommandBuffer* buf = &COMMANDS.buffers[b];
+
+    for (int i = 0; i < buf->cmds.n; i++) {
+      cmdApply(&buf->cmds.a[i]);
+      applied++;
+    }
+    buf->cmds.n = 0;
+  }
+
+  return applied;
+}
@@ -0,0 +1,59 @@
+#ifndef GAME_COMMANDS
+#define GAME_COMMANDS
+#include "ecs.h"
+#include "jobs.h"
+#include "kvec.h"
+#include "thing.h"
+
+/*
+ * =========
+ * @COMMANDS
+ * =========
+ *
+ * Structural changes that can't happen while something is walking the thing
+ * manager or the component store: spawning, destroying, and adding or removing
+ * components. They are recorded into a buffer and applied together by
+ * commandsFlush at a point where nothing is iterating.
+ *
+ * Every job thread records into its own buffer, so recording takes no lock.
+ * Only the main thread and the job threads may record. Buffers are applied in
+ * thread order and each one in the order it was recorded.
+ */
+
+enum {
+  CMD_SPAWN,
+  CMD_DESTROY,
+  CMD_ADD_COMPONENT,
+  CMD_REMOVE_COMPONENT,
+};
+
+typedef struct Command {
+  int type;
+  ThingId id;  // thing to change; unused by CMD_SPAWN
+  int comp;    // component type, for the component commands
+  union {
+    struct {
+      const Thing* like;  // thing to copy everything but the body from
+      Body body;
+    } spawn;
+    AnyComponent data;  // CMD_ADD_COMPONENT
+  };
+} Command;
+
+// aligned so threads recording at once don't share a cache line
+typedef struct CommandBuffer {
+  _Alignas(64) kvec_t(Command) cmds;
+} CommandBuffer;
+
+typedef struct Commands {
+  CommandBuffer buffers[JOBS_MAX_THREADS];  // one per job thread
+} Commands;
+
+extern Commands COMMANDS;
+
+void cmdSpawn(const Thing* like, Body* body);
+void cmdDestroy(ThingId id);
+void cmdAddComponent(ThingId id, int comp, const void* data);
+void cmdRemoveComponent(ThingId id, int comp);
+int commandsFlush();
+#endif
@@ -0,0 +1,191 @@
+#include "ecs.h"
+#include <stdlib.h>
+#include <string.h>
+#include "log.h"
+
+Ecs ECS = {.sets = {
+               [COMP_TRANSFORM] = {.size = sizeof(Transform)},
+               [COMP_VELOCITY] = {.size = sizeof(Velocity)},
+               [COMP_COLLIDER] = {.size = sizeof(Collider)},
+               [COMP_RENDERABLE] = {.size = sizeof(Renderable)},
+               [COMP_MATERIAL] = {.size = sizeof(Material)},
+           }};
+
+/*
+ * ============
+ * @SPARSE SETS
+ * ============
+ */
+
+static void setGrowSparse(ComponentSet* s, Entity e) {
+  uint32_t n = s->n_sparse ? s->n_sparse : 256;
+  while (n <= e) n *= 2;
+
+  s->sparse = realloc(s->sparse, sizeof(uint32_t) * n);
+  if (!s->sparse) {
+    log_error("failed to grow component set to %u entities", n);
+    exit(1);
+  }
+  memset(s->sparse + s->n_sparse, 0xff, sizeof(uint32_t) * (n - s->n_sparse));
+  s->n_sparse = n;
+}
+
+// Grow to hold at least n components.
+static void setGrowDense(ComponentSet* s, uint32_t n) {
+  s->cap = s->cap ? s->cap * 2 : 256;
+  while (s->cap < n) s->cap *= 2;
+  s->entities = realloc(s->entities, sizeof(Entity) * s->cap);
+  s->data = realloc(s->data, s->size * s->cap);
+  if (!s->entities || !s->data) {
+    log_error("failed to grow component set to %u components", s->cap);
+    exit(1);
+  }
+}
+
+static inline uint32_t setFind(ComponentSet* s, Entity e) {
+  return e < s->n_sparse ? s->sparse[e] : ECS_NONE;
+}
+
+// Give e a zeroed component, or return the one it has.
+void* ecsAdd(int comp, Entity e) {
+  ComponentSet* s = &ECS.sets[comp];
+  uint32_t i = setFind(s, e);
+  if (i != ECS_NONE) return s->data + s->size * i;
+
+  if (e >= s->n_sparse) setGrowSparse(s, e);
+  if (s->n == s->cap) setGrowDense(s, s->n + 1);
+
+  i = s->n++;
+  s->sparse[e] = i;
+  s->entities[i] = e;
+  memset(s->data + s->size * i, 0, s->size);
+  return s->data + s->size * i;
+}
+
+// Make room in every set for n more components, of entities below end, so
+// adding many at once grows each set once rather than a doubling at a time.
+void ecsReserve(Entity end, uint32_t n) {
+  for (int c = 0; c < COMP_COUNT; c++) {
+    ComponentSet* s = &ECS.sets[c];
+    if (end > s->n_sparse) setGrowSparse(s, end - 1);
+    if (s->n + n > s->cap) setGrowDense(s, s->n + n);
+  }
+}
+
+void ecsRemove(int comp, Entity e) {
+  ComponentSet* s = &ECS.sets[comp];
+  uint32_t i = setFind(s, e);
+  if (i == ECS_NONE) return;
+
+  // fill the hole with the last component to keep data packed
+  uint32_t last = --s->n;
+  if (i != last) {
+    memcpy(s->data + s->size * i, s->data + s->size * last, s->size);
+    s->entities[i] = s->entities[last];
+    s->sparse[s->entities[i]] = i;
+  }
+  s->sparse[e] = ECS_NONE;
+}
+
+void ecsRemoveAll(Entity e) {
+  for (int c = 0; c < COMP_COUNT; c++) ecsRemove(c, e);
+}
+
+void* ecsGet(int comp, Entity e) {
+  ComponentSet* s = &ECS.sets[comp];
+  uint32_t i = setFind(s, e);
+  return i == ECS_NONE ? NULL : s->data + s->size * i;
+}
+
+bool ecsHas(int comp, Entity e) {
+  return setFind(&ECS.sets[comp], e) != ECS_NONE;
+}
+
+uint32_t ecsCount(int comp) { return ECS.sets[comp].n; }
+
+/*
+ * ========
+ * @QUERIES
+ * ========
+ */
+
+EcsQuery ecsQuery(uint32_t mask) {
+  EcsQuery q = {.mask = mask, .driver = -1, .entity = ECS_NONE};
+
+  for (int c = 0; c < COMP_COUNT; c++) {
+    if (!(mask & COMP_BIT(c))) continue;
+    if (q.driver == -1 || ECS.sets[c].n < ECS.sets[q.driver].n) q.driver = c;
+  }
+
+  for (int c = 0; c < COMP_COUNT; c++) {
+    if ((mask & COMP_BIT(c)) && c != q.driver) q.others[q.n_others++] = c;
+  }
+
+  return q;
+}
+
+// Move on to the next matching entity. Returns false once there are none.
+bool ecsNext(EcsQuery* q) {
+  if (q->driver == -1) return false;
+  ComponentSet* d = &ECS.sets[q->driver];
+
+  while (q->i < d->n) {
+    uint32_t i = q->i++;
+    Entity e = d->entities[i];
+    int o = 0;
+
+    for (; o < q->n_others; o++) {
+      ComponentSet* s = &ECS.sets[q->others[o]];
+      uint32_t j = setFind(s, e);
+      if (j == ECS_NONE) break;
+      q->get[q->others[o]] = s->data + s->size * j;
+    }
+
+    if (o == q->n_others) {
+      q->get[q->driver] = d->data + d->size * i;
+      q->entity = e;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+/*
+ * ======
+ * @THING
+ * ======
+ */
+
+void ecsAddThing(Thing* t) {
+  Entity e = THING_INDEX(t->id);
+  Body* b = &t->body;
+
+  Transform* tr = ecsAdd(COMP_TRANSFORM, e);
+  glm_vec3_copy(b->pos, tr->pos);
+  glm_vec3_copy(b->pos, tr->prev_pos);
+  glm_vec3_copy(b->rot, tr->rot);
+  glm_vec3_copy(b->scale, tr->scale);
+
+  Collider* col = ecsAdd(COMP_COLLIDER, e);
+  glm_vec3_copy(b->halfsize, col->halfsize);
+  col->mass = b->mass;
+  col->is_dynamic = b->is_dynamic;
+  col->is_grounded = b->is_grounded;
+
+  Velocity* v = ecsAdd(COMP_VELOCITY, e);
+  glm_vec3_copy(b->velocity, v->linear);
+
+  if (t->render.rfunc) *(Renderable*)ecsAdd(COMP_RENDERABLE, e) = t->render;
+
+  switch (t->type) {
+    case THING_TRIANGLE:
+    case THING_SQUARE:
+    case THING_CUBE:
+      if (t->self) {
+        Material* m = ecsAdd(COMP_MATERIAL, e);
+        glm_vec4_copy(((CubeThing*)t->self)->color, m->color);
+      }
+      break;
+  }
+}
@@ -0,0 +1,110 @@
+#ifndef GAME_ECS
+#define GAME_ECS
+#include <stdbool.h>
+#include <stdint.h>
+#include "thing.h"
+
+/*
+ * =====
+ * @ECS
+ * =====
+ *
+ * Component storage for things. Each component type lives in its own sparse
+ * set: the components are packed in one contiguous array, with a sparse array
+ * from entity to index alongside. An entity is the slot of a thing in the
+ * thing manager, THING_INDEX of its id, so the store needs no ids of its own.
+ *
+ * Systems go through a query for the components they need instead of
+ * through Thing, so e.g. the renderer never loads a velocity.
+ */
+
+typedef uint32_t Entity;
+
+#define ECS_NONE UINT32_MAX
+
+enum {
+  COMP_TRANSFORM,
+  COMP_VELOCITY,
+  COMP_COLLIDER,
+  COMP_RENDERABLE,
+  COMP_MATERIAL,
+  COMP_COUNT,
+};
+
+#define COMP_BIT(comp) (1u << (comp))
+
+typedef struct Transform {
+  vec3 pos;
+  vec3 prev_pos;  // pos as of the previous physics tick
+  vec3 rot;
+  vec3 scale;
+} Transform;
+
+typedef struct Velocity {
+  vec3 linear;
+} Velocity;
+
+typedef struct Collider {
+  vec3 halfsize;
+  float mass;
+  bool is_dynamic;
+  bool is_grounded;
+} Collider;
+
+// Same layout as the *Thing structs the render funcs take as self.
+typedef struct Material {
+  vec4 color;
+} Material;
+
+// Big enough for any one component, e.g. to carry it around by value.
+typedef union AnyComponent {
+  Transform transform;
+  Velocity velocity;
+  Collider collider;
+  Renderable renderable;
+  Material material;
+} AnyComponent;
+
+typedef struct ComponentSet {
+  size_t size;        // bytes per component
+  uint32_t* sparse;   // entity -> index in data, ECS_NONE if absent
+  uint32_t n_sparse;  // entities sparse has room for
+  Entity* entities;   // entity owning each component
+  char* data;
+  uint32_t n, cap;
+} ComponentSet;
+
+typedef struct Ecs {
+  ComponentSet sets[COMP_COUNT];
+} Ecs;
+
+extern Ecs ECS;
+
+// Walks every entity that has all components in mask. The smallest of those
+// sets drives the walk; the others are looked up per entity. Adding or
+// removing components of the queried types while walking is not allowed.
+typedef struct EcsQuery {
+  uint32_t mask;
+  int driver;              // set being walked
+  uint32_t i;              // next index in the driver
+  int others[COMP_COUNT];  // the other sets in mask
+  int n_others;
+  Entity entity;
+  void* get[COMP_COUNT];  // current entity's components, for types in mask
+} EcsQuery;
+
+void* ecsAdd(int comp, Entity e);
+void ecsReserve(Entity end, uint32_t n);
+void ecsRemove(int comp, Entity e);
+void ecsRemoveAll(Entity e);
+void* ecsGet(int comp, Entity e);
+bool ecsHas(int comp, Entity e);
+uint32_t ecsCount(int comp);
+
+EcsQuery ecsQuery(uint32_t mask);
+bool ecsNext(EcsQuery* q);
+
+// Create a thing's components from the body and render info it was loaded
+// with. Called by thingAdd.
+void ecsAddThing(Thing* t);
+#endif
@@ -0,0 +1,193 @@
+#include "jobs.h"
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "log.h"
+
+Jobs JOBS = {0};
+
+// nested parallel loops run inline instead of waiting on the pool
+static _Thread_local bool IN_JOB = false;
+
+// see jobsThreadIndex
+static _Thread_local int THREAD_INDEX = 0;
+
+static void jobQueuePush(JobQueue* q, Job job) {
+  pthread_mutex_lock(&q->lock);
+  if (q->n == q->cap) {
+    int cap = q->cap ? q->cap * 2 : 64;
+    Job* jobs = malloc(sizeof(Job) * cap);
+    if (!jobs) {
+      log_error("failed to grow job queue to %d jobs", cap);
+      exit(1);
+    }
+
+    for (int i = 0; i < q->n; i++) jobs[i] = q->jobs[(q->head + i) % q->cap];
+    free(q->jobs);
+    q->jobs = jobs;
+    q->head = 0;
+    q->cap = cap;
+  }
+
+  q->jobs[(q->head + q->n++) % q->cap] = job;
+  pthread_mutex_unlock(&q->lock);
+}
+
+// The owner takes the newest job, thieves take the oldest.
+static bool jobQueueTake(JobQueue* q, bool steal, Job* job) {
+  pthread_mutex_lock(&q->lock);
+  if (!q->n) {
+    pthread_mutex_unlock(&q->lock);
+    return false;
+  }
+
+  if (steal) {
+    *job = q->jobs[q->head];
+    q->head = (q->head + 1) % q->cap;
+  } else {
+    *job = q->jobs[(q->head + q->n - 1) % q->cap];
+  }
+  q->n--;
+  pthread_mutex_unlock(&q->lock);
+
+  atomic_fetch_sub(&JOBS.queued, 1);
+  return true;
+}
+
+static bool jobsFind(int self, Job* job) {
+  if (jobQueueTake(&JOBS.queues[self], false, job)) return true;
+
+  for (int i = 1; i < JOBS.n_threads; i++) {
+    int victim = (self + i) % JOBS.n_threads;
+    if (jobQueueTake(&JOBS.queues[victim], true, job)) return true;
+  }
+
+  return false;
+}
+
+static void jobRun(Job* job) {
+  IN_JOB = true;
+  job->f(job->ctx, job->start, job->end);
+  IN_JOB = false;
+  atomic_fetch_sub(&JOBS.pending, 1);
+}
+
+static void* jobsWorker(void* arg) {
+  int self = (int)(size_t)arg;
+  Job job;
+  THREAD_INDEX = self;
+
+  while (!atomic_load(&JOBS.quit)) {
+    if (jobsFind(self, &job)) {
+      jobRun(&job);
+      continue;
+    }
+
+    pthread_mutex_lock(&JOBS.sleep_lock);
+    while (atomic_load(&JOBS.queued) <= 0 && !atomic_load(&JOBS.quit)) {
+      pthread_cond_wait(&JOBS.wake, &JOBS.sleep_lock);
+    }
+    pthread_mutex_unlock(&JOBS.sleep_lock);
+  }
+
+  return NULL;
+}
+
+// Start the pool. n_threads counts the calling thread; 0 means one per core.
+void jobsInit(int n_threads) {
+  if (JOBS.n_threads) return;
+
+  if (n_threads <= 0) {
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    n_threads = cores > 0 ? cores : JOBS_DEFAULT_THREADS;
+  }
+  if (n_threads > JOBS_MAX_THREADS) n_threads = JOBS_MAX_THREADS;
+
+  atomic_store(&JOBS.queued, 0);
+  atomic_store(&JOBS.pending, 0);
+  atomic_store(&JOBS.quit, false);
+  pthread_mutex_init(&JOBS.sleep_lock, NULL);
+  pthread_cond_init(&JOBS.wake, NULL);
+
+  for (int i = 0; i < n_threads; i++) {
+    JobQueue* q = &JOBS.queues[i];
+    memset(q, 0, sizeof(*q));
+    pthread_mutex_init(&q->lock, NULL);
+  }
+
+  // workers read n_threads when stealing, so set it before any start
+  JOBS.n_threads = n_threads;
+  for (int i = 1; i < n_threads; i++) {
+    if (pthread_create(&JOBS.threads[i], NULL, jobsWorker, (void*)(size_t)i)) {
+      log_error("failed to start job thread %d", i);
+      exit(1);
+    }
+  }
+
+  log_info("job system started with %d threads", JOBS.n_threads);
+}
+
+void jobsShutdown() {
+  if (!JOBS.n_threads) return;
+
+  pthread_mutex_lock(&JOBS.sleep_lock);
+  atomic_store(&JOBS.quit, true);
+  pthread_cond_broadcast(&JOBS.wake);
+  pthread_mutex_unlock(&JOBS.sleep_lock);
+
+  for (int i = 1; i < JOBS.n_threads; i++) pthread_join(JOBS.threads[i], NULL);
+
+  for (int i = 0; i < JOBS.n_threads; i++) {
+    pthread_mutex_destroy(&JOBS.queues[i].lock);
+    free(JOBS.queues[i].jobs);
+  }
+  pthread_mutex_destroy(&JOBS.sleep_lock);
+  pthread_cond_destroy(&JOBS.wake);
+
+  JOBS.n_threads = 0;
+}
+
+int jobsThreadCount() { return JOBS.n_threads ? JOBS.n_threads : 1; }
+
+// Which worker the caller is, in [0, JOBS_MAX_THREADS). The thread that
+// started the pool is 0, and so is any thread the pool doesn't know.
+int jobsThreadIndex() { return THREAD_INDEX; }
+
+// Call f over [0, count) in ranges of at most batch indices, and return once
+// every range has run. Ranges may run in any order on any thread, so f must
+// only write state owned by its own indices.
+void jobsParallelFor(JobFunc f, void* ctx, int count, int batch) {
+  if (count <= 0) return;
+  if (batch < 1) batch = 1;
+
+  if (JOBS.n_threads <= 1 || count <= batch || IN_JOB) {
+    f(ctx, 0, count);
+    return;
+  }
+
+  int jobs = (count + batch - 1) / batch;
+  atomic_fetch_add(&JOBS.pending, jobs);
+
+  // deal the ranges out so nobody has to steal at the start
+  for (int j = 0; j < jobs; j++) {
+    int start = j * batch;
+    int end = start + batch < count ? start + batch : count;
+    jobQueuePush(&JOBS.queues[j % JOBS.n_threads],
+                 (Job){.f = f, .ctx = ctx, .start = start, .end = end});
+  }
+
+  pthread_mutex_lock(&JOBS.sleep_lock);
+  atomic_fetch_add(&JOBS.queued, jobs);
+  pthread_cond_broadcast(&JOBS.wake);
+  pthread_mutex_unlock(&JOBS.sleep_lock);
+
+  Job job;
+  while (atomic_load(&JOBS.pending)) {
+    if (jobsFind(0, &job)) {
+      jobRun(&job);
+    } else {
+      sched_yield();
+    }
+  }
+}
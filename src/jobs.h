@@ -0,0 +1,58 @@
+#ifndef GAME_JOBS
+#define GAME_JOBS
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+
+/*
+ * ======
+ * @JOBS
+ * ======
+ *
+ * Fixed pool of worker threads for data-parallel loops. Each worker owns a
+ * queue of index ranges: it takes work from the back of its own queue and,
+ * once that is empty, steals from the front of someone else's. The thread
+ * that calls jobsParallelFor works as worker 0 until the whole loop is done.
+ */
+
+// how many threads jobsInit(0) starts with when the core count is unknown
+#define JOBS_DEFAULT_THREADS 4
+#define JOBS_MAX_THREADS 64
+
+// Run the loop body for indices [start, end).
+typedef void (*JobFunc)(void* ctx, int start, int end);
+
+typedef struct Job {
+  JobFunc f;
+  void* ctx;
+  int start, end;
+} Job;
+
+typedef struct JobQueue {
+  pthread_mutex_t lock;
+  Job* jobs;  // ring buffer
+  int head, n, cap;
+} JobQueue;
+
+typedef struct Jobs {
+  pthread_t threads[JOBS_MAX_THREADS];
+  JobQueue queues[JOBS_MAX_THREADS];
+  int n_threads;  // including the calling thread
+
+  atomic_int queued;   // jobs sitting in a queue
+  atomic_int pending;  // jobs not yet finished
+  atomic_bool quit;
+
+  // workers sleep here while every queue is empty
+  pthread_mutex_t sleep_lock;
+  pthread_cond_t wake;
+} Jobs;
+
+extern Jobs JOBS;
+
+void jobsInit(int n_threads);
+void jobsShutdown();
+int jobsThreadCount();
+int jobsThreadIndex();
+void jobsParallelFor(JobFunc f, void* ctx, int count, int batch);
+#endif
@@ -1,9 +1,9 @@
 #include <math.h>
 #include <stdarg.h>
+#include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 
-#define STB_IMAGE_IMPLEMENTATION
-
 #include "glad.h"
 #include "GLFW/glfw3.h"
 #include "khash.h"
@@ -16,6 +16,12 @@
 #include "log.h"
 #include "thing.h"
 #include "physics.h"
+#include "ecs.h"
+#include "commands.h"
+#include "scene.h"
+#include "world.h"
+#include "replay.h"
+#include "jobs.h"
 
 #include "ft2build.h"
 #include "cglm/cglm.h"
@@ -388,6 +394,17 @@ void pCamInit(int width, int height) {
   pCamUpdateView(width, height);
 }
 
+// Give the shaders the camera as it is now. Once a frame, after it moves.
+void pCamUpload() {
+  CameraBlock block = {0};
+  glm_mat4_copy(pCam.proj, block.proj);
+  glm_mat4_copy(pCam.view, block.view);
+  glm_mat4_mul(pCam.proj, pCam.view, block.view_proj);
+  glm_mat4_copy(pCam.ortho, block.ortho);
+  glm_vec3_copy(pCam.pos, block.pos);
+  cameraBlockUpload(&block);
+}
+
 void pCamPan(double xpos, double ypos) {
   if (pCam.firstInt) {
     pCam.lastx = xpos;
@@ -427,6 +444,13 @@ typedef struct {
 
 static Timer TIMER = {0};
 
+// What the last frame drew, for the once a second log.
+typedef struct {
+  uint32_t visible, culled;
+} FrameStats;
+
+static FrameStats STATS = {0};
+
 uint64_t timeGetNanoseconds() {
   clock_gettime(CLOCK_REALTIME, &TIMER.s);
   return TIMER.s.tv_nsec + (NANOS_PER_SECOND * TIMER.s.tv_sec);
@@ -452,7 +476,8 @@ void timeUpdate() {
     TIMER.fps = TIMER.second_frames;
     TIMER.second_frames = 0;
     TIMER.last_second = TIMER.time;
-    log_debug("FPS: %f | DELTA: %f", TIMER.fps, TIMER.delta);
+    log_debug("FPS: %f | DELTA: %f | VISIBLE: %u | CULLED: %u", TIMER.fps,
+              TIMER.delta, STATS.visible, STATS.culled);
   }
 }
 
@@ -545,6 +570,9 @@ void calculateRayDirection(int width, int height, float x, float y,
  * =======
  */
 
+// how far away the mouse can pick things
+#define PICK_DISTANCE 1000.0f
+
 static Body playerBody = {.scale = {1, 1, 1},
                           .halfsize = {1, 1, 1},
                           .pos = {0, 4, 20},
@@ -553,7 +581,7 @@ static Body playerBody = {.scale = {1, 1, 1},
                           .is_grounded = false};
 
 /* void playerUpdate(Body* colliders, int n_colliders) { */
-void playerUpdate(Body* player_body) {
+void playerUpdate(Velocity* player_velocity) {
   vec3 movement = {0, 0, 0};
   float move_speed = 6;
 
@@ -573,7 +601,7 @@ void playerUpdate(Body* player_body) {
   glm_normalize(movement);
   glm_vec3_scale(movement, move_speed, movement);
   /* glm_vec3_sub(movement, (vec3){0, 9.8, 0}, movement); */
-  glm_vec3_copy(movement, player_body->velocity);
+  glm_vec3_copy(movement, player_velocity->linear);
 
   /* attemptMove(movement, &playerBody, colliders, n_colliders); */
   /* glm_vec3_copy(playerBody.pos, pCam.pos); */
@@ -584,10 +612,15 @@ void playerUpdate(Body* player_body) {
   }
 
   if (MPRESSED(K_MOUSE_LEFT)) {
-    printf("Pressed left mouse");
-    vec3 dest;
-    GET_MOUSE_WORLD_POS(dest);
-    glm_vec3_print(dest, stderr);
+    vec3 dir;
+    Hit hit;
+    GET_MOUSE_WORLD_POS(dir);
+
+    ThingId id = physicsRaycast(pCam.pos, dir, PICK_DISTANCE,
+                                ~PHYSICS_FILTER(THING_PLAYER), &hit);
+    if (id != THING_NULL) {
+      log_debug("picked thing %u at distance %f", THING_INDEX(id), hit.time);
+    }
     MRELEASE(K_MOUSE_LEFT);
   }
 }
@@ -700,10 +733,10 @@ RenderInfo renderTextInit() {
 
 void _renderText(int length, unsigned int shader) {
   if (length) {
-    GL glUniformMatrix4fv(glGetUniformLocation(shader, "transforms"), length,
+    GL glUniformMatrix4fv(shaderLocation(shader, UNIFORM_TRANSFORMS), length,
                           GL_FALSE, &charMats[0][0][0]);
 
-    GL glUniform1iv(glGetUniformLocation(shader, "letterMap"), length,
+    GL glUniform1iv(shaderLocation(shader, UNIFORM_LETTER_MAP), length,
                     &charsToRender[0]);
     GL glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, length);
   }
@@ -715,8 +748,7 @@ void renderText(RenderInfo ri, const char* text, float x, float y, float scale,
   float copyX = x;
 
   GL glUseProgram(ri.shader);
-  shaderSetVec3(ri.shader, "textColor", color);
-  shaderSetMat4(ri.shader, "projection", pCam.ortho);
+  shaderSetVec3Id(ri.shader, UNIFORM_TEXT_COLOR, color);
   GL glActiveTexture(GL_TEXTURE0);
   GL glBindTexture(GL_TEXTURE_2D_ARRAY, fontTextureArray);
   GL glBindVertexArray(ri.vao);
@@ -802,6 +834,9 @@ typedef struct Renderer {
   kh_ri_t* renderinfos;  // map render info to int id
   int curid;             // state used to generate IDs for new things
   bool init;
+  InstanceBatch instances[THING_TYPE_COUNT];  // for types drawn instanced
+  RenderQueue queue;
+  kvec_t(uint64_t) visible;  // bit per thing slot the frustum query reached
 } Renderer;
 
 static Renderer RENDERER = {.renderinfos = NULL, .curid = -1, .init = false};
@@ -812,6 +847,8 @@ void rendererInitialize() {
   }
 
   RENDERER.renderinfos = kh_init_ri();
+  cameraBlockInit();
+  renderQueueInit(&RENDERER.queue, 1024);
 
   RENDERER.curid = 0;
   RENDERER.init = true;
@@ -830,78 +867,203 @@ Result rendererAddThing(Thing* t) {
   // Create renderinfo for this item if we haven't already.
   if ((k = kh_get_ri(RENDERER.renderinfos, t->type)) !=
       kh_end(RENDERER.renderinfos)) {
-    t->render.ri = kh_val(RENDERER.renderinfos, k);
+    ri = kh_val(RENDERER.renderinfos, k);
     log_debug("Already initialized render info for object of type %d: ",
               t->type);
-    return Ok;
-  }
+  } else {
+    ri = (t->render.rinit)();
+    k = kh_put_ri(RENDERER.renderinfos, t->type, &ret);
+    kh_value(RENDERER.renderinfos, k) = ri;
 
-  ri = (t->render.rinit)();
-  k = kh_put_ri(RENDERER.renderinfos, t->type, &ret);
+    // primitives draw instanced; anything else keeps its render func
+    instancesInit(&RENDERER.instances[t->type], t->type);
+  }
 
-  kh_value(RENDERER.renderinfos, k) = ri;
+  // before thingAdd this only lands in the thing; after, in its component
   t->render.ri = ri;
+  Renderable* r = thingGet(t->id) == t
+                      ? ecsGet(COMP_RENDERABLE, THING_INDEX(t->id))
+                      : NULL;
+  if (r) r->ri = ri;
   return Ok;
 }
 
-Result rendererRender(kh_thing_t* things) {
-  khiter_t k;
-  Thing* t;
-  RenderInfo ri;
+// Give every thing of a type the render info for it, e.g. after a scene load
+// added a lot of them at once.
+Result rendererAddType(int type) {
+  ThingList* l = &THINGS.types[type];
+  if (!l->n) return Ok;
 
-  for (khint_t i = kh_begin(things); i != kh_end(things); ++i) {
-    if (!kh_exist(things, i)) continue;
+  Thing* first = thingAt(l->slots[0]);
+  if (!first->render.rfunc) return Ok;
+  if (is_err(rendererAddThing(first))) return Err;
 
-    t = kh_val(things, i);
-    if (!t->render.rfunc) continue;
+  for (uint32_t i = 0; i < l->n; i++) {
+    Renderable* r = ecsGet(COMP_RENDERABLE, l->slots[i]);
+    if (r) r->ri = first->render.ri;
+  }
+  return Ok;
+}
 
-    (t->render.rfunc)(t->self, &t->body, t->render.ri,
-                      (RenderMatrices){.proj = &pCam.proj, .view = &pCam.view},
-                      NULL);
+// Give a streamed-in chunk's things their render info, looking it up once per
+// type like rendererAddType.
+void rendererAddThings(ThingId* ids, uint32_t n) {
+  Thing* first[THING_TYPE_COUNT] = {0};
 
-    // render bounding box as well.
-    if ((t->type == THING_TRIANGLE || t->type == THING_CUBE) &&
-        (k = kh_get_ri(RENDERER.renderinfos, THING_CUBE)) !=
-            kh_end(RENDERER.renderinfos)) {
-      ri = kh_val(RENDERER.renderinfos, k);
+  for (uint32_t i = 0; i < n; i++) {
+    Thing* t = thingGet(ids[i]);
+    if (!t || !t->render.rfunc) continue;
 
-      renderAABB(&(CubeThing){.color = {1, 1, 1, 0.2}}, &t->body, ri,
-                 (RenderMatrices){&pCam.proj, .view = &pCam.view}, NULL);
+    if (!first[t->type]) {
+      if (rendererAddThing(t) == Ok) first[t->type] = t;
+      continue;
     }
+    Renderable* r = ecsGet(COMP_RENDERABLE, THING_INDEX(t->id));
+    if (r) r->ri = first[t->type]->render.ri;
   }
+}
 
-  return Ok;
+// Where to draw a thing this frame.
+static void rendererDrawnBody(Transform* tr, Body* drawn) {
+  *drawn = (Body){0};
+  physicsInterpolate(tr, drawn->pos);
+  glm_vec3_copy(tr->rot, drawn->rot);
+  glm_vec3_copy(tr->scale, drawn->scale);
 }
 
-/*
- * =====
- * @MAIN
- * =====
- */
+// Mark a thing the frustum query reached.
+static bool rendererMarkVisible(void* ctx, int leaf, void* data) {
+  uint64_t* visible = ctx;
+  Entity e = THING_INDEX(((Thing*)data)->id);
+  visible[e >> 6] |= 1ull << (e & 63);
+  return true;
+}
 
-int main(void) {
-  LOGGER.out = stderr;
-  /* pCam = (PerspectiveCamera)pCamInit; */
+// Queue a thing if its box at where it's drawn is in view. The tree only has
+// it where the last tick left it. Returns whether it was queued.
+static bool rendererQueueThing(Frustum* frustum, Entity e, Transform* tr,
+                               Renderable* r) {
+  Body drawn;
+  rendererDrawnBody(tr, &drawn);
+  Collider* c = ecsGet(COMP_COLLIDER, e);
+  if (c) {
+    vec3 min, max;
+    glm_vec3_sub(drawn.pos, c->halfsize, min);
+    glm_vec3_add(drawn.pos, c->halfsize, max);
+    if (frustumTestBox(frustum, min, max) == FRUSTUM_OUTSIDE) return false;
+  }
 
-  WINDOW = (Window)WINDOW_INIT;
-  if (is_err(windowInit())) {
-    return 1;
+  RenderQueue* queue = &RENDERER.queue;
+  Thing* t = thingAt(e);
+  float depth = glm_vec3_distance2(drawn.pos, pCam.pos);
+
+  // colored things draw with their material, anything else with its data
+  Material* m = ecsGet(COMP_MATERIAL, e);
+  void* self = m ? (void*)m : t->self;
+  InstanceBatch* batch = &RENDERER.instances[t->type];
+  if (batch->count) {
+    float* color = ((Material*)self)->color;
+    int pass = color[3] < 1 ? PASS_TRANSPARENT : PASS_OPAQUE;
+    uint64_t key = renderKey(pass, batch->shader, batch->vao, depth);
+    instanceFromBody(renderQueueInstance(queue, key, t->type), &drawn, color);
+  } else {
+    uint64_t key = renderKey(PASS_OPAQUE, r->ri.shader, r->ri.vao, depth);
+    *renderQueueCall(queue, key) = (RenderCall){
+        .rfunc = r->rfunc, .self = self, .body = drawn, .ri = r->ri};
   }
+  return true;
+}
 
-  pCamInit(WINDOW.resx, WINDOW.resy);
+// Queue bounding boxes for the triangles and cubes that were queued, marked in
+// drawn, see-through and sorted in with the rest.
+static void rendererQueueBoxes(const uint64_t* drawn) {
+  InstanceBatch* boxes = &RENDERER.instances[THING_CUBE];
+  if (!boxes->count) return;
+
+  int types[] = {THING_TRIANGLE, THING_CUBE};
+  for (int k = 0; k < 2; k++) {
+    ThingList* l = &THINGS.types[types[k]];
+    for (uint32_t i = 0; i < l->n; i++) {
+      Entity e = l->slots[i];
+      if (!(drawn[e >> 6] >> (e & 63) & 1) || !ecsHas(COMP_RENDERABLE, e)) {
+        continue;
+      }
 
-  glEnable(GL_BLEND);
-  glEnable(GL_DEPTH_TEST);
-  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+      Body body;
+      rendererDrawnBody(ecsGet(COMP_TRANSFORM, e), &body);
+      float depth = glm_vec3_distance2(body.pos, pCam.pos);
+      uint64_t key =
+          renderKey(PASS_TRANSPARENT, boxes->shader, boxes->vao, depth);
+      instanceFromAABB(renderQueueInstance(&RENDERER.queue, key, THING_CUBE),
+                       &body, (vec4){1, 1, 1, 0.2});
+    }
+  }
+}
 
-  textInit();
-  modelLoaderInit();
+Result rendererRender() {
+  // everything drawn goes through the camera, so only what it sees is queued
+  mat4 view_proj;
+  Frustum frustum;
+  glm_mat4_mul(pCam.proj, pCam.view, view_proj);
+  frustumFromMatrix(&frustum, view_proj);
+
+  // The tree skips whole regions out of view, but reaches things in no useful
+  // order. Mark what it reaches, then queue in component order so only those
+  // things' components are read, front to back.
+  size_t words = (THINGS.n_slots + 63) / 64;
+  if (RENDERER.visible.m < words) {
+    kv_resize(uint64_t, RENDERER.visible, words);
+    if (!RENDERER.visible.a) {
+      log_error("failed to allocate visibility for %u things", THINGS.n_slots);
+      exit(1);
+    }
+  }
+  uint64_t* visible = RENDERER.visible.a;
+  memset(visible, 0, sizeof(uint64_t) * words);
+  physicsQueryFrustum(&frustum, rendererMarkVisible, visible);
+
+  // afterwards a queued thing's bit is set, and a culled one's is clear; the
+  // tree can still mark things that have nothing to draw
+  STATS.visible = STATS.culled = 0;
+  EcsQuery q = ecsQuery(COMP_BIT(COMP_TRANSFORM) | COMP_BIT(COMP_RENDERABLE));
+  while (ecsNext(&q)) {
+    Entity e = q.entity;
+    uint64_t bit = 1ull << (e & 63);
+    // things that lost part of their body are out of the tree but still drawn
+    bool reached = visible[e >> 6] & bit || thingAt(e)->proxy == BVH_NULL;
+    if (reached && rendererQueueThing(&frustum, e, q.get[COMP_TRANSFORM],
+                                      q.get[COMP_RENDERABLE])) {
+      visible[e >> 6] |= bit;
+      STATS.visible++;
+    } else {
+      visible[e >> 6] &= ~bit;
+      STATS.culled++;
+    }
+  }
+  rendererQueueBoxes(visible);
 
-  TriangleThing t = {.color = {0, 0, 1, 1}};
-  /* SquareThing s = {.color = {0, 0, 1, 0.2}}; */
-  CubeThing floor = {.color = {0, 0, 1, 0.2}};
-  CubeThing cube = {.color = {0, 0, 1, 0.2}};
+  renderQueueSubmit(&RENDERER.queue, RENDERER.instances,
+                    (RenderMatrices){.proj = &pCam.proj, .view = &pCam.view});
+  return Ok;
+}
+
+/*
+ * =====
+ * @GAME
+ * =====
+ *
+ * Setup and the per-frame update, shared by the windowed game and by replays,
+ * which run the same frames without a window.
+ */
+
+// Things every session starts with. Their data has to outlive them.
+static TriangleThing TRIANGLE_DATA = {.color = {0, 0, 1, 1}};
+static CubeThing FLOOR_DATA = {.color = {0, 0, 1, 0.2}};
+static CubeThing CUBE_DATA = {.color = {0, 0, 1, 0.2}};
 
+// Add the default things and return the player. Replays have no renderer, so
+// they leave render out.
+static Thing* gameAddThings(bool render) {
   Body floorbody = {
       .pos = {0, 0, 0},
       .scale = {100, 1, 100},
@@ -935,22 +1097,21 @@ int main(void) {
   // TODO: abstract thing generation, renderer addition, and thing manager
   // addition
 
-  Thing* triangle = thingLoadFromData(&t, THING_TRIANGLE, &tbody);
-  Thing* triangle2 = thingLoadFromData(&t, THING_TRIANGLE, &tbody_dynamic);
-  Thing* floorthing = thingLoadFromData(&floor, THING_CUBE, &floorbody);
+  Thing* triangle = thingLoadFromData(&TRIANGLE_DATA, THING_TRIANGLE, &tbody);
+  Thing* triangle2 =
+      thingLoadFromData(&TRIANGLE_DATA, THING_TRIANGLE, &tbody_dynamic);
+  Thing* floorthing = thingLoadFromData(&FLOOR_DATA, THING_CUBE, &floorbody);
   /* Thing* bpmodel = thingLoadFromData(&backpack, THING_BACKPACK, &tbody); */
-  Thing* cubething = thingLoadFromData(&cube, THING_CUBE, &tbody);
+  Thing* cubething = thingLoadFromData(&CUBE_DATA, THING_CUBE, &tbody);
   Thing* playerthing = thingLoadFromData(NULL, THING_PLAYER, &playerBody);
 
-  timeInit();
-  rendererInitialize();
-  thingsInit();
-
-  rendererAddThing(triangle);
-  rendererAddThing(triangle2);
-  /* rendererAddThing(bpmodel); */
-  rendererAddThing(floorthing);
-  rendererAddThing(cubething);
+  if (render) {
+    rendererAddThing(triangle);
+    rendererAddThing(triangle2);
+    /* rendererAddThing(bpmodel); */
+    rendererAddThing(floorthing);
+    rendererAddThing(cubething);
+  }
 
   thingAdd(triangle);
   thingAdd(triangle2);
@@ -959,22 +1120,181 @@ int main(void) {
   /* thingAdd(cubething); */
   thingAdd(playerthing);
 
+  return playerthing;
+}
+
+// Load the extra things to play with: a scene saved with sceneSave, or a
+// directory of chunks baked with worldBake to stream in around the camera.
+static void gameLoad(const char* path, Scene* scene, bool render) {
+  struct stat st;
+  if (!stat(path, &st) && S_ISDIR(st.st_mode)) {
+    worldInit(path, render ? rendererAddThings : NULL);
+  } else if (sceneLoad(scene, path) == Ok && render) {
+    for (int type = 0; type < THING_TYPE_COUNT; type++) rendererAddType(type);
+  }
+}
+
+// Everything a frame does but drawing.
+static void gameUpdate(Thing* player, double delta) {
+  Entity e = THING_INDEX(player->id);
+
+  playerUpdate(ecsGet(COMP_VELOCITY, e));
+  physicsPushBody(player);
+  physicsAdvance(delta);
+  // nothing is iterating here, so apply spawns and deletes from the frame
+  commandsFlush();
+  worldUpdate(pCam.pos);
+
+  physicsInterpolate(ecsGet(COMP_TRANSFORM, e), pCam.pos);
+  pCamPan(MOUSE.xpos, MOUSE.ypos);
+}
+
+// What the keybindings and mouse hold at the start of a frame.
+static void inputSave(ReplayFrame* f, double delta) {
+  *f = (ReplayFrame){
+      .delta = delta, .mouse_x = MOUSE.xpos, .mouse_y = MOUSE.ypos};
+  for (int i = 0; i < K_BINDS; i++) f->keys |= !!KPRESSED(i) << i;
+  for (int i = 0; i < K_MOUSE_BINDS; i++) f->buttons |= !!MPRESSED(i) << i;
+}
+
+static void inputLoad(ReplayFrame* f) {
+  MOUSE.xpos = f->mouse_x;
+  MOUSE.ypos = f->mouse_y;
+  for (int i = 0; i < K_BINDS; i++) KPRESSED(i) = f->keys >> i & 1;
+  for (int i = 0; i < K_MOUSE_BINDS; i++) MPRESSED(i) = f->buttons >> i & 1;
+}
+
+// Run a recording without a window and check the bodies end up where they did
+// when it was recorded. Returns the exit code.
+static int gameReplay(const char* path) {
+  Replay replay;
+  if (is_err(replayLoad(&replay, path))) return 1;
+  ReplayHeader* h = &replay.header;
+
+  WINDOW = (Window)WINDOW_INIT;
+  WINDOW.resx = h->resx;
+  WINDOW.resy = h->resy;
+  pCamInit(WINDOW.resx, WINDOW.resy);
+
+  jobsInit(0);
+  thingsInit();
+  Thing* player = gameAddThings(false);
+
+  Scene scene = {0};
+  if (h->scene[0]) {
+    gameLoad(h->scene, &scene, false);
+    if (WORLD.init) {
+      log_warn("streaming depends on loader timing, the replay may differ");
+    }
+  }
+
+  uint64_t start = timeGetNanoseconds();
+  int ticks = PHYSICS.tick;
+  for (uint32_t i = 0; i < h->n_frames; i++) {
+    inputLoad(&replay.frames[i]);
+    gameUpdate(player, replay.frames[i].delta);
+  }
+  double ms = (timeGetNanoseconds() - start) / 1e6;
+  ticks = PHYSICS.tick - ticks;
+
+  float error;
+  uint32_t wrong = replayCompare(&replay, &error);
+  log_info("replayed %u frames, %d ticks in %.1f ms (%.3f ms/tick)",
+           h->n_frames, ticks, ms, ticks ? ms / ticks : 0);
+  if (wrong) {
+    log_error("%u of %u bodies differ from the recording, by up to %f", wrong,
+              h->n_bodies, error);
+  } else {
+    log_info("all %u bodies match the recording", h->n_bodies);
+  }
+
+  worldShutdown();
+  jobsShutdown();
+  replayFree(&replay);
+  return wrong ? 1 : 0;
+}
+
+// Load a scene file without a window and split it into chunk files in dir,
+// for streaming as a world. Returns the exit code.
+static int gameBake(const char* path, const char* dir) {
+  thingsInit();
+  Scene scene = {0};
+  if (is_err(sceneLoad(&scene, path))) return 1;
+  return is_err(worldBake(dir)) ? 1 : 0;
+}
+
+/*
+ * =====
+ * @MAIN
+ * =====
+ */
+
+// usage: replacement [scene or world directory] [--record file]
+//        replacement --replay file
+//        replacement --bake scene directory
+int main(int argc, char** argv) {
+  LOGGER.out = stderr;
+  /* pCam = (PerspectiveCamera)pCamInit; */
+
+  const char* load = NULL;
+  const char* record = NULL;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--replay") && i + 1 < argc) {
+      return gameReplay(argv[i + 1]);
+    } else if (!strcmp(argv[i], "--bake") && i + 2 < argc) {
+      return gameBake(argv[i + 1], argv[i + 2]);
+    } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+      record = argv[++i];
+    } else {
+      load = argv[i];
+    }
+  }
+
+  WINDOW = (Window)WINDOW_INIT;
+  if (is_err(windowInit())) {
+    return 1;
+  }
+
+  pCamInit(WINDOW.resx, WINDOW.resy);
+
+  glEnable(GL_BLEND);
+  glEnable(GL_DEPTH_TEST);
+  glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
+  textInit();
+  modelLoaderInit();
+
+  timeInit();
+  rendererInitialize();
+  jobsInit(0);
+  thingsInit();
+
+  Thing* playerthing = gameAddThings(true);
+
+  Scene scene = {0};
+  if (load) gameLoad(load, &scene, true);
+
+  Replay replay = {0};
+  if (record) replayRecord(&replay, record, load, WINDOW.resx, WINDOW.resy);
+
   log_debug("======================");
   log_debug("BEGIN MAIN RENDER LOOP");
   log_debug("======================");
 
-  glm_vec3_print(playerthing->body.halfsize, stderr);
+  Entity player = THING_INDEX(playerthing->id);
+  glm_vec3_print(((Collider*)ecsGet(COMP_COLLIDER, player))->halfsize, stderr);
 
   while (!windowShouldClose()) {
     windowNewFrame();
     windowPoll();
-    playerUpdate(&playerthing->body);
-    physicsUpdate(THINGS.things, TIMER.delta);
 
-    glm_vec3_copy(playerthing->body.pos, pCam.pos);
-    pCamPan(MOUSE.xpos, MOUSE.ypos);
+    ReplayFrame frame;
+    inputSave(&frame, TIMER.delta);
+    replayRecordFrame(&replay, &frame);
+    gameUpdate(playerthing, TIMER.delta);
+    pCamUpload();
 
-    rendererRender(THINGS.things);
+    rendererRender();
 
     /* renderText(tri, "Hello there", 300.0f, 300.0f, 1.0f, (vec3){0.5, 0.8,
      * 0.2}, */
@@ -984,6 +1304,9 @@ int main(void) {
     timeUpdate();
   }
 
+  if (record) replayFinish(&replay);
+  worldShutdown();
+  jobsShutdown();
   windowTerminate();
 
   return 0;
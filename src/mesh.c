@@ -3,6 +3,7 @@
 #include "stdio.h"
 #include "utils.h"
 #include <stddef.h>
+#define STB_IMAGE_IMPLEMENTATION
 #include "mesh.h"
 #include "utils.h"
 
@@ -45,17 +46,15 @@ void modelLoaderInit() {
 }
 
 const char* modelVert =
-    "#version 330 core\n"
+    "#version 330 core\n" CAMERA_GLSL
     "layout(location = 0) in vec3 aPos;\n"
     "layout(location = 1) in vec3 aNormal;\n"
     "layout(location = 2) in vec2 aTexCoords;\n"
     "out vec2 TexCoords;\n"
-    "uniform mat4 projection;\n"
-    "uniform mat4 view;\n"
     "uniform mat4 model;\n"
     "void main() {\n"
     "TexCoords = aTexCoords;\n"
-    "gl_Position = projection * view * model * vec4(aPos, 1.0);\n"
+    "gl_Position = viewProj * model * vec4(aPos, 1.0);\n"
     "}\n";
 
 const char* modelFrag =
@@ -67,20 +66,16 @@ const char* modelFrag =
     "fragColor = texture(texture_diffuse1, TexCoords);\n"
     "}";
 
-enum TEXTURE_TYPE {
-  T_SPECULAR,
-  T_DIFFUSE,
-  T_NORMAL,
-  T_AMBIENT,
-  T_OTHER,
-  T_TYPES,
-};
-
 const char* textureNames[T_TYPES] = {
     "texture_specular", "texture_diffuse", "texture_normal",
     "texture_height",   "texture_other",
 };
 
+// Uniform handles of texture_diffuse1, texture_diffuse2, ... for each type,
+// made once so drawing needn't build the names.
+#define MESH_TEXTURE_UNIFORMS 8
+static int textureUniforms[T_TYPES][MESH_TEXTURE_UNIFORMS];
+
 void meshSetup(Mesh* dest) {
   unsigned int vbo, ebo;
   glGenVertexArrays(1, &dest->ri.vao);
@@ -110,22 +105,25 @@ void meshSetup(Mesh* dest) {
 }
 
 void meshDraw(Mesh* m, int shader) {
-  unsigned int diffuseNr = 1;
-  unsigned int specularNr = 1;
-  char uniform[256];
+  unsigned int diffuseNr = 0;
+  unsigned int specularNr = 0;
+  int uniform;
 
   for (unsigned int i = 0; i < m->textures.n; i++) {
     GL glActiveTexture(GL_TEXTURE0 + i);
 
+    // shaders sample fewer textures of a type than there are handles for
     switch (m->textures.a[i].type) {
       case (T_DIFFUSE):
-        uniform[snprintf(uniform, 256, "%s%d", textureNames[T_DIFFUSE],
-                         diffuseNr)] = '\0';
+        uniform = diffuseNr < MESH_TEXTURE_UNIFORMS
+                      ? textureUniforms[T_DIFFUSE][diffuseNr]
+                      : -1;
         diffuseNr++;
         break;
       case (T_SPECULAR):
-        uniform[snprintf(uniform, 256, "%s%d", textureNames[T_SPECULAR],
-                         specularNr)] = '\0';
+        uniform = specularNr < MESH_TEXTURE_UNIFORMS
+                      ? textureUniforms[T_SPECULAR][specularNr]
+                      : -1;
         specularNr++;
         break;
 
@@ -133,7 +131,7 @@ void meshDraw(Mesh* m, int shader) {
         continue;
     }
 
-    shaderSetInt(shader, uniform, (int)i);
+    shaderSetIntId(shader, uniform, (int)i);
     GL glBindTexture(GL_TEXTURE_2D, m->textures.a[i].id);
   }
 
@@ -152,9 +150,7 @@ void renderModel(Model* m, Body* body, RenderInfo ri, RenderMatrices rm,
   glm_mat4_identity(model);
   glm_translate(model, body->pos);
 
-  shaderSetMat4(ri.shader, "projection", *rm.proj);
-  shaderSetMat4(ri.shader, "view", *rm.view);
-  shaderSetMat4(ri.shader, "model", model);
+  shaderSetMat4Id(ri.shader, UNIFORM_MODEL, model);
 
   for (unsigned int i = 0; i < m->meshes.n; i++) {
     meshDraw(&m->meshes.a[i], ri.shader);
@@ -319,6 +315,14 @@ void processAssimpNode(Model* model, struct aiNode* node,
 }
 
 RenderInfo renderInitModel() {
+  char uniform[256];
+  for (int t = 0; t < T_TYPES; t++) {
+    for (int i = 0; i < MESH_TEXTURE_UNIFORMS; i++) {
+      snprintf(uniform, sizeof(uniform), "%s%d", textureNames[t], i + 1);
+      textureUniforms[t][i] = shaderUniform(uniform);
+    }
+  }
+
   unsigned int modelShader = shaderFromCharVF(modelVert, modelFrag);
   return (RenderInfo){.vao = 0, .shader = modelShader};
 }
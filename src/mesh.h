@@ -17,6 +17,15 @@ typedef struct MeshVertex
   vec3 bitangent;
 } MeshVertex;
 
+enum TEXTURE_TYPE {
+  T_SPECULAR,
+  T_DIFFUSE,
+  T_NORMAL,
+  T_AMBIENT,
+  T_OTHER,
+  T_TYPES,
+};
+
 typedef struct MeshTexture
 {
   unsigned int id;
@@ -47,6 +56,7 @@ extern const char *modelVert;
 extern const char *modelFrag;
 
 void modelLoaderInit();
+void meshDraw(Mesh *m, int shader);
 Result modelLoadFromFile(Model *model, char *path);
 void renderModel(Model *m, Body *body, RenderInfo ri, RenderMatrices rm,
                  RenderMods *mods);
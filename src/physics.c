@@ -1,8 +1,15 @@
 #include "physics.h"
 #include "utils.h"
+#include "jobs.h"
+#include "khash.h"
 
-#define N_STEPS 4.0f
-#define TICK_RATE 1.0f / N_STEPS
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+Physics PHYSICS = {0};
 
 void aabbMinMax(Body* b, vec3 min, vec3 max) {
   glm_vec3_sub(b->pos, b->halfsize, min);
@@ -77,7 +84,6 @@ Hit aabbIntersectRay(vec3 pos, vec3 magnitude, Body* body) {
   }
 
   if (tmin <= tmax) {
-    log_debug("TMIN: %f, TMAX: %f", tmin, tmax);
     hit.pos[0] = pos[0] + magnitude[0] * tmin;
     hit.pos[1] = pos[1] + magnitude[1] * tmin;
     hit.pos[2] = pos[2] + magnitude[2] * tmin;
@@ -93,67 +99,1505 @@ Hit aabbIntersectRay(vec3 pos, vec3 magnitude, Body* body) {
   return hit;
 }
 
-void physicsSweep(Body* b, vec3 velocity, kh_thing_t* things) {
-  Hit closest = {0};
-  closest.time = INFINITY;
-  Thing* t;
-  Body* other;
+/*
+ * Batched version of aabbIntersectRay: one ray against up to AABB_BATCH boxes.
+ * Each lane runs exactly the same float operations as the scalar test, so the
+ * two agree bit for bit. Lanes are packed as follows: tmin holds the entry
+ * time, and code holds the hit axis + 1, negated when the normal points down
+ * the axis (0 when the ray starts inside the box).
+ */
+
+#if defined(__AVX2__)
+static int slab8(vec3 pos, vec3 magnitude, AABBBatch* b, float* tmin_out,
+                 float* code_out) {
+  float* mins[3] = {b->minx, b->miny, b->minz};
+  float* maxs[3] = {b->maxx, b->maxy, b->maxz};
+  __m256 tmin = _mm256_setzero_ps(), tmax = _mm256_set1_ps(1.0f);
+  __m256 code = _mm256_setzero_ps(), miss = _mm256_setzero_ps();
+
+  for (int i = 0; i < 3; i++) {
+    __m256 lo = _mm256_loadu_ps(mins[i]), hi = _mm256_loadu_ps(maxs[i]);
+    __m256 p = _mm256_set1_ps(pos[i]);
 
-  for (int i = kh_begin(things); i < kh_end(things); i++) {
-    if (!kh_exist(things, i)) continue;
-    t = kh_val(things, i);
-    other = &t->body;
+    if (fabsf(magnitude[i]) > 1e-8f) {
+      __m256 m = _mm256_set1_ps(magnitude[i]);
+      __m256 t1 = _mm256_div_ps(_mm256_sub_ps(lo, p), m);
+      __m256 t2 = _mm256_div_ps(_mm256_sub_ps(hi, p), m);
+      __m256 tnear = _mm256_min_ps(t1, t2), tfar = _mm256_max_ps(t1, t2);
 
-    if (other == b) continue;
-    Body expanded = *other;
-    glm_vec3_add(b->halfsize, other->halfsize, expanded.halfsize);
+      __m256 c = _mm256_blendv_ps(_mm256_set1_ps(i + 1),
+                                  _mm256_set1_ps(-(i + 1)),
+                                  _mm256_cmp_ps(t1, t2, _CMP_LT_OQ));
+      code = _mm256_blendv_ps(code, c, _mm256_cmp_ps(tnear, tmin, _CMP_GT_OQ));
 
-    Hit hit = aabbIntersectRay(b->pos, velocity, &expanded);
-    if (hit.is_hit && hit.time < closest.time) {
-      closest = hit;
+      tmin = _mm256_max_ps(tmin, tnear);
+      tmax = _mm256_min_ps(tmax, tfar);
+      miss = _mm256_or_ps(miss, _mm256_cmp_ps(tmin, tmax, _CMP_GT_OQ));
+    } else {
+      // ray is parallel to slab
+      miss = _mm256_or_ps(miss, _mm256_cmp_ps(p, lo, _CMP_LT_OQ));
+      miss = _mm256_or_ps(miss, _mm256_cmp_ps(p, hi, _CMP_GT_OQ));
     }
   }
 
-  if (!closest.is_hit) {
-    glm_vec3_add(b->pos, velocity, b->pos);
-    return;
+  _mm256_storeu_ps(tmin_out, tmin);
+  _mm256_storeu_ps(code_out, code);
+  return ~_mm256_movemask_ps(miss) & 0xff;
+}
+#elif defined(__SSE2__)
+static int slab4(vec3 pos, vec3 magnitude, AABBBatch* b, int off,
+                 float* tmin_out, float* code_out) {
+  float* mins[3] = {b->minx + off, b->miny + off, b->minz + off};
+  float* maxs[3] = {b->maxx + off, b->maxy + off, b->maxz + off};
+  __m128 tmin = _mm_setzero_ps(), tmax = _mm_set1_ps(1.0f);
+  __m128 code = _mm_setzero_ps(), miss = _mm_setzero_ps();
+
+  for (int i = 0; i < 3; i++) {
+    __m128 lo = _mm_loadu_ps(mins[i]), hi = _mm_loadu_ps(maxs[i]);
+    __m128 p = _mm_set1_ps(pos[i]);
+
+    if (fabsf(magnitude[i]) > 1e-8f) {
+      __m128 m = _mm_set1_ps(magnitude[i]);
+      __m128 t1 = _mm_div_ps(_mm_sub_ps(lo, p), m);
+      __m128 t2 = _mm_div_ps(_mm_sub_ps(hi, p), m);
+      __m128 tnear = _mm_min_ps(t1, t2), tfar = _mm_max_ps(t1, t2);
+
+      __m128 down = _mm_cmplt_ps(t1, t2);
+      __m128 c = _mm_or_ps(_mm_and_ps(down, _mm_set1_ps(-(i + 1))),
+                           _mm_andnot_ps(down, _mm_set1_ps(i + 1)));
+      __m128 upd = _mm_cmpgt_ps(tnear, tmin);
+      code = _mm_or_ps(_mm_and_ps(upd, c), _mm_andnot_ps(upd, code));
+
+      tmin = _mm_max_ps(tmin, tnear);
+      tmax = _mm_min_ps(tmax, tfar);
+      miss = _mm_or_ps(miss, _mm_cmpgt_ps(tmin, tmax));
+    } else {
+      // ray is parallel to slab
+      miss = _mm_or_ps(miss, _mm_cmplt_ps(p, lo));
+      miss = _mm_or_ps(miss, _mm_cmpgt_ps(p, hi));
+    }
+  }
+
+  _mm_storeu_ps(tmin_out + off, tmin);
+  _mm_storeu_ps(code_out + off, code);
+  return (~_mm_movemask_ps(miss) & 0xf) << off;
+}
+#else
+static int slabScalar(vec3 pos, vec3 magnitude, AABBBatch* b, int lane,
+                      float* tmin_out, float* code_out) {
+  float mins[3] = {b->minx[lane], b->miny[lane], b->minz[lane]};
+  float maxs[3] = {b->maxx[lane], b->maxy[lane], b->maxz[lane]};
+  float tmin = 0.0f, tmax = 1.0f, code = 0.0f;
+
+  for (int i = 0; i < 3; i++) {
+    if (fabsf(magnitude[i]) > 1e-8f) {
+      float t1 = (mins[i] - pos[i]) / magnitude[i];
+      float t2 = (maxs[i] - pos[i]) / magnitude[i];
+      float tnear = fminf(t1, t2), tfar = fmaxf(t1, t2);
+
+      if (tnear > tmin) code = t1 < t2 ? -(i + 1) : i + 1;
+
+      tmin = fmaxf(tmin, tnear);
+      tmax = fminf(tmax, tfar);
+      if (tmin > tmax) return 0;
+    } else if (pos[i] < mins[i] || pos[i] > maxs[i]) {
+      return 0;
+    }
+  }
+
+  tmin_out[lane] = tmin;
+  code_out[lane] = code;
+  return 1 << lane;
+}
+#endif
+
+// Find the earliest of b's boxes hit by pos + magnitude * t, t in [0, 1].
+// index is set to the box's lane, or -1 if nothing was hit. Ties go to the
+// lowest lane, like testing the boxes one at a time would.
+Hit aabbIntersectRayBatch(vec3 pos, vec3 magnitude, AABBBatch* b, int* index) {
+  Hit hit = {0};
+  float tmin[AABB_BATCH], code[AABB_BATCH];
+  int hits = 0;
+
+#if defined(__AVX2__)
+  hits = slab8(pos, magnitude, b, tmin, code);
+#elif defined(__SSE2__)
+  hits = slab4(pos, magnitude, b, 0, tmin, code);
+  if (b->n > 4) hits |= slab4(pos, magnitude, b, 4, tmin, code);
+#else
+  for (int lane = 0; lane < b->n; lane++) {
+    hits |= slabScalar(pos, magnitude, b, lane, tmin, code);
+  }
+#endif
+
+  hits &= (1 << b->n) - 1;
+  *index = -1;
+
+  for (; hits; hits &= hits - 1) {
+    int lane = __builtin_ctz(hits);
+    if (*index == -1 || tmin[lane] < tmin[*index]) *index = lane;
+  }
+
+  if (*index == -1) return hit;
+
+  float t = tmin[*index];
+  int c = (int)code[*index];
+  hit.pos[0] = pos[0] + magnitude[0] * t;
+  hit.pos[1] = pos[1] + magnitude[1] * t;
+  hit.pos[2] = pos[2] + magnitude[2] * t;
+
+  if (c != 0) {
+    hit.normal[abs(c) - 1] = c < 0 ? -1.0f : 1.0f;
+  }
+
+  hit.is_hit = true;
+  hit.time = t;
+  return hit;
+}
+
+/*
+ * ===========
+ * @BODY STORE
+ * ===========
+ *
+ * Packed copies of the body fields the physics loop touches, one slot per
+ * thing. The store is what gets simulated. The Transform, Velocity and
+ * Collider components are written back after every tick for the renderer and
+ * gameplay code, and gameplay changes to them are copied in with
+ * physicsPushBody.
+ */
+
+BodyStore BODIES = {0};
+
+// see @BROADPHASE
+static Bvh TREE = {0};
+static bool TREE_INIT = false;
+
+// see @SLEEP
+static void physicsWake(BodyStore* s, int i);
+
+#define MASK_WORDS(n) (((n) + 63) >> 6)
+#define MASK_GET(m, i) (((m)[(i) >> 6] >> ((i) & 63)) & 1)
+
+static inline void maskSet(uint64_t* m, int i, bool v) {
+  if (v) {
+    m[i >> 6] |= 1ull << (i & 63);
+  } else {
+    m[i >> 6] &= ~(1ull << (i & 63));
+  }
+}
+
+static void bodyStoreGrow(BodyStore* s) {
+  int cap = s->cap ? s->cap * 2 : 256;
+  float** fields[] = {&s->px,  &s->py,  &s->pz, &s->ppx, &s->ppy, &s->ppz,
+                      &s->vx,  &s->vy,  &s->vz, &s->hx,  &s->hy,  &s->hz};
+
+  for (int f = 0; f < sizeof(fields) / sizeof(fields[0]); f++) {
+    *fields[f] = realloc(*fields[f], sizeof(float) * cap);
+  }
+  s->things = realloc(s->things, sizeof(Thing*) * cap);
+  s->still = realloc(s->still, cap);
+  s->landed = realloc(s->landed, cap);
+  s->hit_axis = realloc(s->hit_axis, cap);
+  s->restless = realloc(s->restless, cap);
+  s->hit = realloc(s->hit, sizeof(int) * cap);
+  s->island = realloc(s->island, sizeof(int) * cap);
+  s->contacts = realloc(s->contacts, sizeof(int) * cap);
+
+  s->dynamic = realloc(s->dynamic, sizeof(uint64_t) * MASK_WORDS(cap));
+  s->grounded = realloc(s->grounded, sizeof(uint64_t) * MASK_WORDS(cap));
+  s->awake = realloc(s->awake, sizeof(uint64_t) * MASK_WORDS(cap));
+  memset(s->dynamic + MASK_WORDS(s->cap), 0,
+         sizeof(uint64_t) * (MASK_WORDS(cap) - MASK_WORDS(s->cap)));
+  memset(s->grounded + MASK_WORDS(s->cap), 0,
+         sizeof(uint64_t) * (MASK_WORDS(cap) - MASK_WORDS(s->cap)));
+  memset(s->awake + MASK_WORDS(s->cap), 0,
+         sizeof(uint64_t) * (MASK_WORDS(cap) - MASK_WORDS(s->cap)));
+
+  if (!s->px || !s->hz || !s->things || !s->still || !s->landed ||
+      !s->hit_axis || !s->restless || !s->hit || !s->island ||
+      !s->contacts || !s->dynamic || !s->grounded || !s->awake) {
+    log_error("failed to grow body store to %d bodies", cap);
+    exit(1);
+  }
+
+  s->cap = cap;
+}
+
+static void bodyStoreMove(BodyStore* s, int dst, int src) {
+  s->px[dst] = s->px[src];
+  s->py[dst] = s->py[src];
+  s->pz[dst] = s->pz[src];
+  s->ppx[dst] = s->ppx[src];
+  s->ppy[dst] = s->ppy[src];
+  s->ppz[dst] = s->ppz[src];
+  s->vx[dst] = s->vx[src];
+  s->vy[dst] = s->vy[src];
+  s->vz[dst] = s->vz[src];
+  s->hx[dst] = s->hx[src];
+  s->hy[dst] = s->hy[src];
+  s->hz[dst] = s->hz[src];
+  maskSet(s->dynamic, dst, MASK_GET(s->dynamic, src));
+  maskSet(s->grounded, dst, MASK_GET(s->grounded, src));
+  maskSet(s->awake, dst, MASK_GET(s->awake, src));
+  s->still[dst] = s->still[src];
+  s->hit[dst] = s->hit[src];
+
+  s->things[dst] = s->things[src];
+  s->things[dst]->body_idx = dst;
+}
+
+static inline void bodyStorePos(BodyStore* s, int i, vec3 dest) {
+  dest[0] = s->px[i];
+  dest[1] = s->py[i];
+  dest[2] = s->pz[i];
+}
+
+static inline void bodyStoreHalfsize(BodyStore* s, int i, vec3 dest) {
+  dest[0] = s->hx[i];
+  dest[1] = s->hy[i];
+  dest[2] = s->hz[i];
+}
+
+// Copy a thing's components into its slot in the store, e.g. after gameplay
+// code changed its velocity or teleported it.
+void physicsPushBody(Thing* t) {
+  BodyStore* s = &BODIES;
+  Entity e = THING_INDEX(t->id);
+  Transform* tr = ecsGet(COMP_TRANSFORM, e);
+  Velocity* v = ecsGet(COMP_VELOCITY, e);
+  Collider* c = ecsGet(COMP_COLLIDER, e);
+  int i = t->body_idx;
+
+  // wake whatever rests on it before it moves
+  if (t->proxy != BVH_NULL) physicsWake(s, i);
+
+  s->px[i] = tr->pos[0];
+  s->py[i] = tr->pos[1];
+  s->pz[i] = tr->pos[2];
+  s->ppx[i] = tr->prev_pos[0];
+  s->ppy[i] = tr->prev_pos[1];
+  s->ppz[i] = tr->prev_pos[2];
+  s->vx[i] = v->linear[0];
+  s->vy[i] = v->linear[1];
+  s->vz[i] = v->linear[2];
+  s->hx[i] = c->halfsize[0];
+  s->hy[i] = c->halfsize[1];
+  s->hz[i] = c->halfsize[2];
+  maskSet(s->dynamic, i, c->is_dynamic);
+  maskSet(s->grounded, i, c->is_grounded);
+
+  if (t->proxy != BVH_NULL) {
+    vec3 min, max;
+    glm_vec3_sub(tr->pos, c->halfsize, min);
+    glm_vec3_add(tr->pos, c->halfsize, max);
+    bvhMove(&TREE, t->proxy, min, max, (vec3){0, 0, 0});
+  }
+}
+
+// Copy the simulated state of a slot back into its thing's components.
+static void physicsPullBody(BodyStore* s, int i) {
+  Entity e = THING_INDEX(s->things[i]->id);
+  Transform* tr = ecsGet(COMP_TRANSFORM, e);
+  Velocity* v = ecsGet(COMP_VELOCITY, e);
+  Collider* c = ecsGet(COMP_COLLIDER, e);
+
+  bodyStorePos(s, i, tr->pos);
+  tr->prev_pos[0] = s->ppx[i];
+  tr->prev_pos[1] = s->ppy[i];
+  tr->prev_pos[2] = s->ppz[i];
+  v->linear[0] = s->vx[i];
+  v->linear[1] = s->vy[i];
+  v->linear[2] = s->vz[i];
+  c->is_grounded = MASK_GET(s->grounded, i);
+}
+
+/*
+ * ======
+ * @SLEEP
+ * ======
+ *
+ * Dynamic bodies that stay still for PHYSICS_SLEEP_TICKS are put to sleep and
+ * skipped by the tick until something wakes them. Bodies touching each other
+ * form an island, and an island only sleeps once every body in it is still, so
+ * a crate can't doze off while the one under it is still settling. Waking a
+ * body wakes everything asleep that touches it, and so on outwards.
+ */
+
+// bodies waiting to be woken
+static kvec_t(int) WAKE = {0};
+
+typedef struct IslandQuery {
+  BodyStore* s;
+  int self;
+} IslandQuery;
+
+// Body box grown by the contact margin.
+static void bodyStoreContactBox(BodyStore* s, int i, vec3 min, vec3 max) {
+  float m = PHYSICS_CONTACT_MARGIN;
+  min[0] = s->px[i] - s->hx[i] - m;
+  min[1] = s->py[i] - s->hy[i] - m;
+  min[2] = s->pz[i] - s->hz[i] - m;
+  max[0] = s->px[i] + s->hx[i] + m;
+  max[1] = s->py[i] + s->hy[i] + m;
+  max[2] = s->pz[i] + s->hz[i] + m;
+}
+
+static bool wakeHit(void* ctx, int leaf, void* data) {
+  BodyStore* s = ctx;
+  int other = ((Thing*)data)->body_idx;
+
+  if (MASK_GET(s->dynamic, other) && !MASK_GET(s->awake, other)) {
+    kv_push(int, WAKE, other);
+  }
+  return true;
+}
+
+static void physicsWakeQueued(BodyStore* s) {
+  while (WAKE.n) {
+    int i = kv_pop(WAKE);
+    if (MASK_GET(s->awake, i)) continue;
+
+    maskSet(s->awake, i, true);
+    s->still[i] = 0;
+
+    vec3 min, max;
+    bodyStoreContactBox(s, i, min, max);
+    bvhQueryAABB(&TREE, min, max, wakeHit, s);
+  }
+}
+
+// Wake slot i and its island. Does nothing if it is already awake.
+static void physicsWake(BodyStore* s, int i) {
+  kv_push(int, WAKE, i);
+  physicsWakeQueued(s);
+}
+
+// Wake everything asleep that touches the box, and their islands.
+static void physicsWakeAround(BodyStore* s, vec3 min, vec3 max) {
+  bvhQueryAABB(&TREE, min, max, wakeHit, s);
+  physicsWakeQueued(s);
+}
+
+void physicsWakeThing(Thing* t) {
+  if (t->proxy == BVH_NULL) return;
+  physicsWake(&BODIES, t->body_idx);
+}
+
+static int islandFind(int* parent, int i) {
+  while (parent[i] != i) {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+static bool islandLink(void* ctx, int leaf, void* data) {
+  IslandQuery* q = ctx;
+  BodyStore* s = q->s;
+  int other = ((Thing*)data)->body_idx;
+
+  if (other == q->self || !MASK_GET(s->dynamic, other) ||
+      !MASK_GET(s->awake, other)) {
+    return true;
+  }
+
+  int a = islandFind(s->island, q->self);
+  int b = islandFind(s->island, other);
+  if (a != b) s->island[a] = b;
+  return true;
+}
+
+// Put to sleep every island whose bodies have all been still long enough.
+// Only bodies that are ready to sleep look for their neighbours: an island
+// with a moving body stays awake whatever else it contains, so links between
+// moving bodies never matter.
+static void physicsSleep(BodyStore* s) {
+  int words = MASK_WORDS(s->n);
+  bool ready = false;
+
+  for (int w = 0; w < words; w++) {
+    for (uint64_t m = s->dynamic[w] & s->awake[w]; m; m &= m - 1) {
+      int i = (w << 6) + __builtin_ctzll(m);
+      s->island[i] = i;
+      s->restless[i] = false;
+      ready |= s->still[i] >= PHYSICS_SLEEP_TICKS;
+    }
+  }
+  if (!ready) return;
+
+  for (int w = 0; w < words; w++) {
+    for (uint64_t m = s->dynamic[w] & s->awake[w]; m; m &= m - 1) {
+      int i = (w << 6) + __builtin_ctzll(m);
+      if (s->still[i] < PHYSICS_SLEEP_TICKS) continue;
+
+      IslandQuery q = {.s = s, .self = i};
+      vec3 min, max;
+      bodyStoreContactBox(s, i, min, max);
+      bvhQueryAABB(&TREE, min, max, islandLink, &q);
+    }
+  }
+
+  for (int w = 0; w < words; w++) {
+    for (uint64_t m = s->dynamic[w] & s->awake[w]; m; m &= m - 1) {
+      int i = (w << 6) + __builtin_ctzll(m);
+      if (s->still[i] < PHYSICS_SLEEP_TICKS) {
+        s->restless[islandFind(s->island, i)] = true;
+      }
+    }
+  }
+
+  for (int w = 0; w < words; w++) {
+    for (uint64_t m = s->dynamic[w] & s->awake[w]; m; m &= m - 1) {
+      int i = (w << 6) + __builtin_ctzll(m);
+      if (s->still[i] < PHYSICS_SLEEP_TICKS) continue;
+      if (s->restless[islandFind(s->island, i)]) continue;
+
+      maskSet(s->awake, i, false);
+      s->vx[i] = s->vy[i] = s->vz[i] = 0;
+      s->hit[i] = -1;
+      s->ppx[i] = s->px[i];
+      s->ppy[i] = s->py[i];
+      s->ppz[i] = s->pz[i];
+      physicsPullBody(s, i);
+    }
+  }
+}
+
+/*
+ * =========
+ * @CONTACTS
+ * =========
+ *
+ * Pairs of things in contact, keyed by their ids. A pair begins when a sweep
+ * stops at the other thing, and stays until the two boxes are further apart
+ * than PHYSICS_CONTACT_MARGIN. Each tick appends a begin, stay or end event
+ * per pair to PHYSICS.events.
+ *
+ * Every body slot also heads a list of its pairs, linked both ways through
+ * the pairs, so removing or moving a body only touches its own pairs.
+ */
+
+typedef struct ContactPair {
+  uint64_t key;
+  ThingId a, b;  // ordered by thing manager slot
+  int ia, ib;    // their slots in the body store
+  vec3 normal;  // points from b towards a
+  int tick;     // last tick a sweep stopped on this pair
+  int next[2], prev[2];  // neighbours in ia's and in ib's list, or -1
+} ContactPair;
+
+KHASH_MAP_INIT_INT64(pair, int);
+
+static khash_t(pair)* PAIR_INDEX = NULL;  // key -> index in PAIRS
+static kvec_t(ContactPair) PAIRS = {0};
+
+// Live things never share a thing manager slot, so the two slots make a
+// unique key. Pairs are ended before either thing leaves, so a reused slot
+// can't inherit one.
+static inline uint64_t pairKey(ThingId a, ThingId b) {
+  uint32_t x = THING_INDEX(a), y = THING_INDEX(b);
+  return x < y ? (uint64_t)x << 32 | y : (uint64_t)y << 32 | x;
+}
+
+static void contactEmit(ContactPair* p, int type) {
+  ContactEvent e = {.type = type, .a = p->a, .b = p->b, .tick = PHYSICS.tick};
+  glm_vec3_copy(p->normal, e.normal);
+  kv_push(ContactEvent, PHYSICS.events, e);
+}
+
+// Put the pair at idx at the front of both its bodies' lists.
+static void contactLink(BodyStore* s, int idx) {
+  ContactPair* p = &PAIRS.a[idx];
+  for (int side = 0; side < 2; side++) {
+    int body = side ? p->ib : p->ia;
+    int head = s->contacts[body];
+    p->prev[side] = -1;
+    p->next[side] = head;
+    if (head != -1) {
+      ContactPair* q = &PAIRS.a[head];
+      q->prev[q->ib == body] = idx;
+    }
+    s->contacts[body] = idx;
+  }
+}
+
+// The links to the pair at idx in one of its bodies' lists: the one before
+// it, and the one after it or NULL at the end. side is 0 for ia, 1 for ib.
+static void contactLinks(BodyStore* s, int idx, int side, int** before,
+                         int** after) {
+  ContactPair* p = &PAIRS.a[idx];
+  int body = side ? p->ib : p->ia;
+  ContactPair* q;
+
+  if (p->prev[side] == -1) {
+    *before = &s->contacts[body];
+  } else {
+    q = &PAIRS.a[p->prev[side]];
+    *before = &q->next[q->ib == body];
   }
 
-  // we actually have a collision
-  if (closest.normal[0] != 0) {
-    b->velocity[0] = 0;
-  } else if (closest.normal[1] != 0) {
-    b->velocity[1] = 0;
-    b->is_grounded = true;
+  if (p->next[side] == -1) {
+    *after = NULL;
   } else {
-    b->velocity[2] = 0;
+    q = &PAIRS.a[p->next[side]];
+    *after = &q->prev[q->ib == body];
+  }
+}
+
+static void contactRemove(int idx) {
+  BodyStore* s = &BODIES;
+  ContactPair* p = &PAIRS.a[idx];
+  int *before, *after;
+  for (int side = 0; side < 2; side++) {
+    contactLinks(s, idx, side, &before, &after);
+    *before = p->next[side];
+    if (after) *after = p->prev[side];
+  }
+
+  khiter_t k = kh_get(pair, PAIR_INDEX, p->key);
+  kh_del(pair, PAIR_INDEX, k);
+
+  // fill the hole with the last pair
+  int last = --PAIRS.n;
+  if (idx != last) {
+    for (int side = 0; side < 2; side++) {
+      contactLinks(s, last, side, &before, &after);
+      *before = idx;
+      if (after) *after = idx;
+    }
+    *p = PAIRS.a[last];
+    k = kh_get(pair, PAIR_INDEX, p->key);
+    kh_val(PAIR_INDEX, k) = idx;
+  }
+}
+
+// Record that slot i's sweep stopped at slot other this tick.
+static void contactTouch(BodyStore* s, int i, int other, vec3 normal) {
+  Thing* self = s->things[i];
+  Thing* hit = s->things[other];
+  uint64_t key = pairKey(self->id, hit->id);
+
+  int ret;
+  khiter_t k = kh_put(pair, PAIR_INDEX, key, &ret);
+  if (ret) {
+    ContactPair p = {.key = key, .tick = -1};
+    bool first = THING_INDEX(self->id) < THING_INDEX(hit->id);
+    p.a = first ? self->id : hit->id;
+    p.b = first ? hit->id : self->id;
+    p.ia = first ? i : other;
+    p.ib = first ? other : i;
+    kh_val(PAIR_INDEX, k) = PAIRS.n;
+    kv_push(ContactPair, PAIRS, p);
+    contactLink(s, PAIRS.n - 1);
+  }
+
+  ContactPair* p = &PAIRS.a[kh_val(PAIR_INDEX, k)];
+  if (p->tick == PHYSICS.tick) return;  // both hit each other
+
+  // the sweep's normal points back at the body that moved
+  if (p->ia == i) {
+    glm_vec3_copy(normal, p->normal);
+  } else {
+    glm_vec3_negate_to(normal, p->normal);
+  }
+
+  contactEmit(p, ret ? CONTACT_BEGIN : CONTACT_STAY);
+  p->tick = PHYSICS.tick;
+}
+
+static bool bodyStoreTouching(BodyStore* s, int i, int j) {
+  float m = PHYSICS_CONTACT_MARGIN;
+  return fabsf(s->px[i] - s->px[j]) <= s->hx[i] + s->hx[j] + m &&
+         fabsf(s->py[i] - s->py[j]) <= s->hy[i] + s->hy[j] + m &&
+         fabsf(s->pz[i] - s->pz[j]) <= s->hz[i] + s->hz[j] + m;
+}
+
+// Carry every pair no sweep stopped on this tick: it stays while the boxes
+// still touch and ends once they don't. Pairs where neither body moved are
+// kept without testing.
+static void physicsUpdateContacts(BodyStore* s) {
+  for (int p = 0; p < PAIRS.n;) {
+    ContactPair* pair = &PAIRS.a[p];
+    if (pair->tick == PHYSICS.tick) {
+      p++;
+      continue;
+    }
+
+    int i = pair->ia, j = pair->ib;
+    bool moved = (MASK_GET(s->dynamic, i) && MASK_GET(s->awake, i)) ||
+                 (MASK_GET(s->dynamic, j) && MASK_GET(s->awake, j));
+
+    if (!moved || bodyStoreTouching(s, i, j)) {
+      contactEmit(pair, CONTACT_STAY);
+      p++;
+    } else {
+      contactEmit(pair, CONTACT_END);
+      contactRemove(p);
+    }
+  }
+}
+
+// End every pair a thing is part of, before it leaves the world.
+static void physicsEndContacts(Thing* t) {
+  int* head = &BODIES.contacts[t->body_idx];
+  while (*head != -1) {
+    contactEmit(&PAIRS.a[*head], CONTACT_END);
+    contactRemove(*head);
+  }
+}
+
+// Point pairs at a body's new slot after the store moved it.
+static void physicsMoveContacts(int dst, int src) {
+  BodyStore* s = &BODIES;
+  for (int p = s->contacts[src]; p != -1;) {
+    ContactPair* pair = &PAIRS.a[p];
+    int side = pair->ib == src;
+    if (side) {
+      pair->ib = dst;
+    } else {
+      pair->ia = dst;
+    }
+    p = pair->next[side];
+  }
+  s->contacts[dst] = s->contacts[src];
+}
+
+/*
+ * ===========
+ * @BROADPHASE
+ * ===========
+ *
+ * Every thing gets a leaf in a dynamic AABB tree when it is added to the thing
+ * manager. Static bodies never touch the tree again; dynamic bodies are only
+ * reinserted once they leave their fat box.
+ *
+ * A tick sweeps every dynamic body against where everything else was at the
+ * start of the tick, so sweeps don't depend on each other and run on the job
+ * pool. The tree is only read while they run; results are applied to it
+ * afterwards on one thread, in slot order, so any thread count gives the same
+ * result.
+ */
+
+
+void physicsInit() {
+  if (TREE_INIT) return;
+  bvhInit(&TREE);
+  TREE_INIT = true;
+  PAIR_INDEX = kh_init(pair);
+
+  PHYSICS.accumulator = 0;
+  PHYSICS.tick_rate = PHYSICS_TICK_RATE;
+  PHYSICS.max_steps = PHYSICS_MAX_STEPS;
+  PHYSICS.alpha = 1.0f;
+  PHYSICS.tick = 0;
+}
+
+// Give t a slot in the store and fill it from its components.
+static void bodyStoreAdd(BodyStore* s, Thing* t) {
+  t->body_idx = s->n++;
+  s->things[t->body_idx] = t;
+  maskSet(s->awake, t->body_idx, true);
+  s->still[t->body_idx] = 0;
+  s->hit[t->body_idx] = -1;
+  s->contacts[t->body_idx] = -1;
+  physicsPushBody(t);
+}
+
+static inline void bodyStoreBox(BodyStore* s, int i, vec3 min, vec3 max) {
+  vec3 pos, halfsize;
+  bodyStorePos(s, i, pos);
+  bodyStoreHalfsize(s, i, halfsize);
+  glm_vec3_sub(pos, halfsize, min);
+  glm_vec3_add(pos, halfsize, max);
+}
+
+void physicsAddThing(Thing* t) {
+  BodyStore* s = &BODIES;
+  if (s->n == s->cap) bodyStoreGrow(s);
+  bodyStoreAdd(s, t);
+
+  vec3 min, max;
+  bodyStoreBox(s, t->body_idx, min, max);
+  t->proxy = bvhInsert(&TREE, min, max, t);
+}
+
+// Add many things at once, building their part of the broadphase in one go.
+void physicsAddThings(Thing** things, int n) {
+  BodyStore* s = &BODIES;
+  while (s->n + n > s->cap) bodyStoreGrow(s);
+
+  vec3* mins = malloc(sizeof(vec3) * n * 2);
+  int* proxies = malloc(sizeof(int) * n);
+  if (!mins || !proxies) {
+    log_error("failed to allocate broadphase boxes for %d things", n);
+    exit(1);
+  }
+  vec3* maxs = mins + n;
+
+  for (int i = 0; i < n; i++) {
+    bodyStoreAdd(s, things[i]);
+    bodyStoreBox(s, things[i]->body_idx, mins[i], maxs[i]);
+  }
+
+  bvhInsertBatch(&TREE, n, mins, maxs, (void**)things, proxies);
+  for (int i = 0; i < n; i++) things[i]->proxy = proxies[i];
+
+  free(mins);
+  free(proxies);
+}
+
+void physicsRemoveThing(Thing* t) {
+  if (t->proxy == BVH_NULL) return;
+  BodyStore* s = &BODIES;
+
+  physicsEndContacts(t);
+
+  // anything resting on it has to notice it's gone
+  vec3 min, max;
+  bodyStoreContactBox(s, t->body_idx, min, max);
+  physicsWakeAround(s, min, max);
+
+  bvhRemove(&TREE, t->proxy);
+  t->proxy = BVH_NULL;
+
+  // fill the hole with the last slot to keep the store packed
+  if (t->body_idx != s->n - 1) {
+    bodyStoreMove(s, t->body_idx, s->n - 1);
+    physicsMoveContacts(t->body_idx, s->n - 1);
+  }
+  s->n--;
+  maskSet(s->dynamic, s->n, false);
+  maskSet(s->grounded, s->n, false);
+  maskSet(s->awake, s->n, false);
+  t->body_idx = -1;
+}
+
+typedef struct Sweep {
+  int self;  // slot of the body being moved
+  vec3 pos, halfsize;
+  vec3 velocity;  // motion left this tick
+  Hit closest;
+  int other;        // slot of the closest hit
+  AABBBatch batch;  // candidates waiting for the narrowphase
+
+  // Everything the tick's motion could reach, gathered once up front. Sliding
+  // never leaves the box spanned by the first motion, so each slide only
+  // re-runs the narrowphase on these.
+  AABBBatch cands[PHYSICS_SLIDE_CANDIDATES / AABB_BATCH];
+  int n_cands;
+  bool overflow;  // too many to keep, walk the tree on every slide instead
+} Sweep;
+
+static void sweepTest(Sweep* sw, AABBBatch* b) {
+  int lane;
+  Hit hit = aabbIntersectRayBatch(sw->pos, sw->velocity, b, &lane);
+  if (hit.is_hit && hit.time < sw->closest.time) {
+    sw->closest = hit;
+    sw->other = b->idx[lane];
+  }
+}
+
+// Add slot other, grown by our halfsize, to a batch.
+static void sweepQueue(Sweep* sw, AABBBatch* b, int other) {
+  BodyStore* s = &BODIES;
+
+  // other bodies may be mid-sweep on another thread, so use their position
+  // from the start of the tick
+  int lane = b->n++;
+  float hx = sw->halfsize[0] + s->hx[other];
+  float hy = sw->halfsize[1] + s->hy[other];
+  float hz = sw->halfsize[2] + s->hz[other];
+  b->minx[lane] = s->ppx[other] - hx;
+  b->miny[lane] = s->ppy[other] - hy;
+  b->minz[lane] = s->ppz[other] - hz;
+  b->maxx[lane] = s->ppx[other] + hx;
+  b->maxy[lane] = s->ppy[other] + hy;
+  b->maxz[lane] = s->ppz[other] + hz;
+  b->idx[lane] = other;
+}
+
+static bool sweepGather(void* ctx, int leaf, void* data) {
+  Sweep* sw = ctx;
+  int other = ((Thing*)data)->body_idx;
+  if (other == sw->self) return true;
+
+  if (sw->n_cands == PHYSICS_SLIDE_CANDIDATES) {
+    sw->overflow = true;
+    return false;
+  }
+
+  sweepQueue(sw, &sw->cands[sw->n_cands++ / AABB_BATCH], other);
+  return true;
+}
+
+// Queue each leaf the tree finds and run the narrowphase a full batch at a
+// time.
+static float sweepHit(void* ctx, int leaf, void* data, float tmax) {
+  Sweep* sw = ctx;
+  int other = ((Thing*)data)->body_idx;
+  if (other == sw->self) return tmax;
+
+  sweepQueue(sw, &sw->batch, other);
+  if (sw->batch.n < AABB_BATCH) return tmax;
+
+  sweepTest(sw, &sw->batch);
+  sw->batch.n = 0;
+  return fminf(tmax, sw->closest.time);
+}
+
+// Find the first thing hit by the motion left in sw->velocity.
+static void sweepCast(Sweep* sw) {
+  sw->closest = (Hit){.time = INFINITY};
+
+  if (!sw->overflow) {
+    for (int b = 0; b * AABB_BATCH < sw->n_cands; b++) {
+      sweepTest(sw, &sw->cands[b]);
+    }
+    return;
+  }
+
+  sw->batch.n = 0;
+  bvhQueryRay(&TREE, sw->pos, sw->velocity, sw->halfsize, 1.0f, sweepHit, sw);
+  if (sw->batch.n) sweepTest(sw, &sw->batch);
+}
+
+// Move slot i along its velocity for one tick. Each hit stops the motion
+// along the surface normal and slides the rest along the surface, up to
+// PHYSICS_SLIDE_ITERATIONS times. Only writes slot i, so sweeps can run in
+// parallel.
+static void physicsSweep(BodyStore* s, int i, float delta_time) {
+  Sweep sw = {.self = i};
+  bodyStorePos(s, i, sw.pos);
+  bodyStoreHalfsize(s, i, sw.halfsize);
+  sw.velocity[0] = s->vx[i] * delta_time;
+  sw.velocity[1] = s->vy[i] * delta_time;
+  sw.velocity[2] = s->vz[i] * delta_time;
+
+  vec3 min, max;
+  for (int a = 0; a < 3; a++) {
+    float end = sw.pos[a] + sw.velocity[a];
+    min[a] = (sw.velocity[a] < 0 ? end : sw.pos[a]) - sw.halfsize[a];
+    max[a] = (sw.velocity[a] < 0 ? sw.pos[a] : end) + sw.halfsize[a];
+  }
+  bvhQueryAABB(&TREE, min, max, sweepGather, &sw);
+
+  s->landed[i] = false;
+  s->hit[i] = -1;
+
+  for (int it = 0; it < PHYSICS_SLIDE_ITERATIONS; it++) {
+    if (glm_vec3_norm2(sw.velocity) < 1e-12f) break;
+
+    sweepCast(&sw);
+    Hit closest = sw.closest;
+
+    if (!closest.is_hit) {
+      glm_vec3_add(sw.pos, sw.velocity, sw.pos);
+      break;
+    }
+
+    int axis = closest.normal[0] != 0 ? 0 : closest.normal[1] != 0 ? 1 : 2;
+    if (axis == 0) s->vx[i] = 0;
+    if (axis == 1) s->vy[i] = 0;
+    if (axis == 2) s->vz[i] = 0;
+    if (axis == 1 && closest.normal[1] > 0) s->landed[i] = true;
+
+    // the first thing we ran into is the one contacts and waking care about
+    if (s->hit[i] == -1) {
+      s->hit[i] = sw.other;
+      s->hit_axis[i] = closest.normal[axis] > 0 ? axis + 1 : -(axis + 1);
+    }
+
+    // stop just short of the surface we hit...
+    vec3 moved;
+    glm_vec3_scale(sw.velocity, closest.time, moved);
+    glm_vec3_muladds(closest.normal, 1e-4f, moved);
+    glm_vec3_add(sw.pos, moved, sw.pos);
+
+    // ...and slide the rest of the way along it
+    glm_vec3_scale(sw.velocity, 1.0f - closest.time, sw.velocity);
+    sw.velocity[axis] = 0;
+  }
+
+  s->px[i] = sw.pos[0];
+  s->py[i] = sw.pos[1];
+  s->pz[i] = sw.pos[2];
+}
+
+typedef struct PhysicsJob {
+  BodyStore* s;
+  float delta_time;
+} PhysicsJob;
+
+// Integrate and sweep the dynamic bodies in mask words [start, end).
+static void physicsStepJob(void* ctx, int start, int end) {
+  PhysicsJob* job = ctx;
+  BodyStore* s = job->s;
+  float gravity = 9.8f * job->delta_time;
+
+  for (int w = start; w < end; w++) {
+    // Gravity pulls on grounded bodies too. Their sweep then lands on the
+    // floor again, which is what keeps them grounded.
+    for (uint64_t m = s->dynamic[w] & s->awake[w]; m; m &= m - 1) {
+      int i = (w << 6) + __builtin_ctzll(m);
+      s->vy[i] -= gravity;
+      physicsSweep(s, i, job->delta_time);
+
+      float speed = s->vx[i] * s->vx[i] + s->vy[i] * s->vy[i] +
+                    s->vz[i] * s->vz[i];
+      if (speed >= PHYSICS_SLEEP_VELOCITY * PHYSICS_SLEEP_VELOCITY) {
+        s->still[i] = 0;
+      } else if (s->still[i] < UINT8_MAX) {
+        s->still[i]++;
+      }
+    }
+  }
+}
+
+// Apply a sweep's result to the shared state: grounded bit, broadphase and
+// the thing's body.
+static void physicsResolve(BodyStore* s, int i) {
+  maskSet(s->grounded, i, s->landed[i]);
+
+  vec3 min, max, moved;
+  Body b = {0};
+  bodyStorePos(s, i, b.pos);
+  bodyStoreHalfsize(s, i, b.halfsize);
+  aabbMinMax(&b, min, max);
+  moved[0] = s->px[i] - s->ppx[i];
+  moved[1] = s->py[i] - s->ppy[i];
+  moved[2] = s->pz[i] - s->ppz[i];
+  bvhMove(&TREE, s->things[i]->proxy, min, max, moved);
+
+  physicsPullBody(s, i);
+}
+
+void physicsUpdate(double delta_time) {
+  BodyStore* s = &BODIES;
+  int words = MASK_WORDS(s->n);
+  PHYSICS.tick++;
+
+  memcpy(s->ppx, s->px, sizeof(float) * s->n);
+  memcpy(s->ppy, s->py, sizeof(float) * s->n);
+  memcpy(s->ppz, s->pz, sizeof(float) * s->n);
+
+  PhysicsJob job = {.s = s, .delta_time = delta_time};
+  jobsParallelFor(physicsStepJob, &job, words, PHYSICS_JOB_WORDS);
+
+  for (int w = 0; w < words; w++) {
+    for (uint64_t m = s->dynamic[w] & s->awake[w]; m; m &= m - 1) {
+      physicsResolve(s, (w << 6) + __builtin_ctzll(m));
+    }
+  }
+
+  // record contacts, and wake anything asleep that got run into along with
+  // its island
+  for (int w = 0; w < words; w++) {
+    for (uint64_t m = s->dynamic[w] & s->awake[w]; m; m &= m - 1) {
+      int i = (w << 6) + __builtin_ctzll(m);
+      if (s->hit[i] == -1) continue;
+
+      vec3 normal = {0, 0, 0};
+      int axis = abs(s->hit_axis[i]) - 1;
+      normal[axis] = s->hit_axis[i] > 0 ? 1.0f : -1.0f;
+      contactTouch(s, i, s->hit[i], normal);
+      physicsWake(s, s->hit[i]);
+    }
+  }
+
+  physicsUpdateContacts(s);
+
+  physicsSleep(s);
+}
+
+// Run as many fixed ticks as the time since the last frame allows, up to
+// PHYSICS.max_steps. If we fall further behind than that the extra time is
+// dropped, so one slow frame can't make every following frame slower.
+int physicsAdvance(double frame_delta) {
+  int steps = 0;
+  PHYSICS.accumulator += frame_delta;
+  PHYSICS.events.n = 0;
+
+  while (PHYSICS.accumulator >= PHYSICS.tick_rate) {
+    if (steps == PHYSICS.max_steps) {
+      PHYSICS.accumulator = fmod(PHYSICS.accumulator, PHYSICS.tick_rate);
+      break;
+    }
+
+    physicsUpdate(PHYSICS.tick_rate);
+    PHYSICS.accumulator -= PHYSICS.tick_rate;
+    steps++;
+  }
+
+  PHYSICS.alpha = PHYSICS.accumulator / PHYSICS.tick_rate;
+  return steps;
+}
+
+// Where to draw a body: between its last two ticks, by how far we are into
+// the next one.
+void physicsInterpolate(Transform* tr, vec3 dest) {
+  glm_vec3_lerp(tr->prev_pos, tr->pos, PHYSICS.alpha, dest);
+}
+
+/*
+ * ======
+ * @STATE
+ * ======
+ *
+ * The whole simulation saved into one buffer of 32-bit words and loaded back,
+ * for rollback and replays. The layout is a PhysicsStateHeader, then per body
+ * slot its thing id and each body store field as its own array, then the fat
+ * box of its broadphase leaf, then the masks, then the contact pairs. Saving
+ * is mostly memcpys; loading into a store holding the same things in the same
+ * slots is too.
+ *
+ * Fat boxes are saved because waking and islands query the tree, so a tree
+ * with other fat boxes would wake other bodies and the rerun would differ.
+ */
+
+typedef struct PhysicsStateHeader {
+  uint32_t n_bodies, n_pairs;
+  int32_t tick;
+  uint32_t pad;
+  double accumulator;
+} PhysicsStateHeader;
+
+typedef struct PhysicsStatePair {
+  ThingId a, b;
+  vec3 normal;
+  int tick;
+} PhysicsStatePair;
+
+#define STATE_WORDS(bytes) (((bytes) + 3) / 4)
+#define STATE_FIELDS 12  // float arrays per body, see physicsStateFields
+#define STATE_BOX 6       // fat box floats per body
+
+static void physicsStateFields(BodyStore* s, float** fields) {
+  float* f[STATE_FIELDS] = {s->px,  s->py,  s->pz, s->ppx, s->ppy, s->ppz,
+                            s->vx,  s->vy,  s->vz, s->hx,  s->hy,  s->hz};
+  memcpy(fields, f, sizeof(f));
+}
+
+static size_t physicsStateWords(uint32_t n, uint32_t n_pairs) {
+  return STATE_WORDS(sizeof(PhysicsStateHeader)) +
+         STATE_WORDS(sizeof(ThingId) * n) + (STATE_FIELDS + STATE_BOX) * n +
+         3 * STATE_WORDS(sizeof(uint64_t) * MASK_WORDS(n)) + STATE_WORDS(n) +
+         STATE_WORDS(sizeof(PhysicsStatePair) * n_pairs);
+}
+
+// Copy bytes to w, zeroing the rest of the last word, and return the word
+// after them.
+static inline uint32_t* stateWrite(uint32_t* w, const void* src, size_t bytes) {
+  if (bytes % 4) w[bytes / 4] = 0;
+  memcpy(w, src, bytes);
+  return w + STATE_WORDS(bytes);
+}
+
+// Words physicsSaveState needs for the current state.
+size_t physicsStateSize() { return physicsStateWords(BODIES.n, PAIRS.n); }
+
+// Save every body, the thing in each body slot, the contact pairs and the
+// tick count to dest, which holds physicsStateSize() words.
+void physicsSaveState(uint32_t* dest) {
+  BodyStore* s = &BODIES;
+  PhysicsStateHeader h = {.n_bodies = s->n,
+                          .n_pairs = PAIRS.n,
+                          .tick = PHYSICS.tick,
+                          .accumulator = PHYSICS.accumulator};
+  uint32_t* w = stateWrite(dest, &h, sizeof(h));
+
+  for (int i = 0; i < s->n; i++) {
+    memcpy(w + 2 * i, &s->things[i]->id, sizeof(ThingId));
+  }
+  w += STATE_WORDS(sizeof(ThingId) * s->n);
+
+  float* fields[STATE_FIELDS];
+  physicsStateFields(s, fields);
+  for (int f = 0; f < STATE_FIELDS; f++) {
+    w = stateWrite(w, fields[f], sizeof(float) * s->n);
+  }
+
+  for (int f = 0; f < STATE_BOX; f++, w += s->n) {
+    for (int i = 0; i < s->n; i++) {
+      BvhNode* leaf = &TREE.nodes[s->things[i]->proxy];
+      float* box = f < 3 ? leaf->min : leaf->max;
+      memcpy(w + i, &box[f % 3], sizeof(float));
+    }
+  }
+
+  size_t mask_bytes = sizeof(uint64_t) * MASK_WORDS(s->n);
+  w = stateWrite(w, s->dynamic, mask_bytes);
+  w = stateWrite(w, s->grounded, mask_bytes);
+  w = stateWrite(w, s->awake, mask_bytes);
+  w = stateWrite(w, s->still, s->n);
+
+  for (int p = 0; p < PAIRS.n; p++) {
+    PhysicsStatePair sp = {.a = PAIRS.a[p].a,
+                           .b = PAIRS.a[p].b,
+                           .tick = PAIRS.a[p].tick};
+    glm_vec3_copy(PAIRS.a[p].normal, sp.normal);
+    w = stateWrite(w, &sp, sizeof(sp));
+  }
+}
+
+// Delete every thing with a body that isn't in the saved state.
+static void physicsStateDeleteOthers(const uint32_t* ids, uint32_t n) {
+  BodyStore* s = &BODIES;
+  uint32_t* want = calloc(THINGS.n_slots + 1, sizeof(uint32_t));
+  kvec_t(ThingId) others = {0};
+  if (!want) {
+    log_error("failed to allocate %u slots to load physics state",
+              THINGS.n_slots);
+    exit(1);
   }
 
-  // 2. Update position of the body to reflect the collision.
-  glm_vec3_scale(closest.normal, 1e-4f, closest.normal);
+  for (uint32_t i = 0; i < n; i++) {
+    ThingId id;
+    memcpy(&id, ids + 2 * i, sizeof(id));
+    if (THING_INDEX(id) < THINGS.n_slots) {
+      want[THING_INDEX(id)] = THING_GENERATION(id);
+    }
+  }
+  for (int i = 0; i < s->n; i++) {
+    ThingId id = s->things[i]->id;
+    if (want[THING_INDEX(id)] != THING_GENERATION(id)) {
+      kv_push(ThingId, others, id);
+    }
+  }
+  for (int i = 0; i < others.n; i++) thingDelete(others.a[i]);
 
-  glm_vec3_scale(velocity, closest.time, velocity);
-  glm_vec3_add(velocity, closest.normal, velocity);
-  glm_vec3_add(b->pos, velocity, b->pos);
+  kv_destroy(others);
+  free(want);
 }
 
-void physicsUpdate(kh_thing_t* things, double delta_time) {
-  Body* b;
-  Thing* t;
-  for (int i = kh_begin(things); i < kh_end(things); i++) {
-    if (!kh_exist(things, i)) continue;
+// Load a state saved by physicsSaveState. Things spawned since it was saved
+// are deleted, and things deleted since are revived if they were kept (see
+// thingsKeepDeleted). Any that weren't can't be brought back: the rest is
+// still loaded, but it returns Err. Call it where nothing is iterating things.
+Result physicsLoadState(const uint32_t* src, size_t n_words) {
+  BodyStore* s = &BODIES;
+  PhysicsStateHeader h;
+  if (n_words < STATE_WORDS(sizeof(h))) {
+    log_error("physics state is truncated");
+    return Err;
+  }
+  memcpy(&h, src, sizeof(h));
+  if (physicsStateWords(h.n_bodies, h.n_pairs) != n_words) {
+    log_error("physics state is corrupt");
+    return Err;
+  }
+
+  uint32_t n = h.n_bodies;
+  const uint32_t* ids = src + STATE_WORDS(sizeof(h));
+  const uint32_t* w = ids + STATE_WORDS(sizeof(ThingId) * n);
+
+  // pairs are rebuilt from the state below, without events
+  kh_clear(pair, PAIR_INDEX);
+  PAIRS.n = 0;
+  for (int i = 0; i < s->n; i++) s->contacts[i] = -1;
+  physicsStateDeleteOthers(ids, n);
+  for (uint32_t i = 0; i < n; i++) {
+    ThingId id;
+    memcpy(&id, ids + 2 * i, sizeof(id));
+    Thing* t;
+    if (!thingGet(id) && (t = thingRevive(id))) physicsAddThing(t);
+  }
+
+  // the usual case, rolling back a few ticks, leaves every body where it was
+  bool same = s->n == n;
+  for (uint32_t i = 0; same && i < n; i++) {
+    same = !memcmp(&s->things[i]->id, ids + 2 * i, sizeof(ThingId));
+  }
+
+  // slot in the store of each saved body, -1 if its thing is gone
+  int* slot = malloc(sizeof(int) * (n + 1));
+  uint64_t* masks = malloc(sizeof(uint64_t) * 3 * (MASK_WORDS(n) + 1));
+  if (!slot || !masks) {
+    log_error("failed to allocate %u bodies to load physics state", n);
+    exit(1);
+  }
+
+  uint32_t missing = 0;
+  for (uint32_t i = 0; i < n; i++) {
+    ThingId id;
+    memcpy(&id, ids + 2 * i, sizeof(id));
+    Thing* t = thingGet(id);
+    slot[i] = t ? t->body_idx : -1;
+    missing += !t;
+  }
+
+  float* fields[STATE_FIELDS];
+  physicsStateFields(s, fields);
+  for (int f = 0; f < STATE_FIELDS; f++, w += n) {
+    if (same) {
+      memcpy(fields[f], w, sizeof(float) * n);
+      continue;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      if (slot[i] != -1) memcpy(&fields[f][slot[i]], w + i, sizeof(float));
+    }
+  }
+
+  // fat boxes, which go into the tree once the store is loaded
+  const uint32_t* boxes = w;
+  w += STATE_BOX * n;
 
-    t = kh_val(things, i);
-    b = &t->body;
+  size_t mask_words = MASK_WORDS(n);
+  uint64_t* dynamic = masks;
+  uint64_t* grounded = masks + mask_words;
+  uint64_t* awake = masks + 2 * mask_words;
+  for (int m = 0; m < 3; m++) {
+    memcpy(masks + m * mask_words, w, sizeof(uint64_t) * mask_words);
+    w += STATE_WORDS(sizeof(uint64_t) * mask_words);
+  }
+  const uint8_t* still = (const uint8_t*)w;
+  w += STATE_WORDS(n);
 
-    if (!b->is_dynamic) continue;
+  for (uint32_t i = 0; i < n; i++) {
+    int j = slot[i];
+    if (j == -1) continue;
+    maskSet(s->dynamic, j, MASK_GET(dynamic, i));
+    maskSet(s->grounded, j, MASK_GET(grounded, i));
+    maskSet(s->awake, j, MASK_GET(awake, i));
+    s->still[j] = still[i];
+  }
 
-    if (!b->is_grounded) {
-      b->velocity[1] -= 9.8f * delta_time;
+  for (uint32_t i = 0; i < n; i++) {
+    if (slot[i] == -1) continue;
+    vec3 box[2];
+    for (int f = 0; f < STATE_BOX; f++) {
+      memcpy(&box[f / 3][f % 3], boxes + f * n + i, sizeof(float));
     }
+    bvhSetFatBox(&TREE, s->things[slot[i]]->proxy, box[0], box[1]);
+  }
+
+  // bring the components up to date
+  for (int j = 0; j < s->n; j++) {
+    Thing* t = s->things[j];
+    Collider* c = ecsGet(COMP_COLLIDER, THING_INDEX(t->id));
 
-    vec3 scaled_velocity;
-    glm_vec3_scale(b->velocity, delta_time, scaled_velocity);
-    physicsSweep(b, scaled_velocity, things);
+    s->hit[j] = -1;
+    physicsPullBody(s, j);
+
+    bodyStoreHalfsize(s, j, c->halfsize);
+    c->is_dynamic = MASK_GET(s->dynamic, j);
+  }
+
+  for (uint32_t p = 0; p < h.n_pairs; p++) {
+    PhysicsStatePair sp;
+    memcpy(&sp, w, sizeof(sp));
+    w += STATE_WORDS(sizeof(sp));
+
+    Thing* a = thingGet(sp.a);
+    Thing* b = thingGet(sp.b);
+    if (!a || !b) continue;
+
+    ContactPair pair = {.key = pairKey(sp.a, sp.b),
+                        .a = sp.a,
+                        .b = sp.b,
+                        .ia = a->body_idx,
+                        .ib = b->body_idx,
+                        .tick = sp.tick};
+    glm_vec3_copy(sp.normal, pair.normal);
+
+    int ret;
+    khiter_t k = kh_put(pair, PAIR_INDEX, pair.key, &ret);
+    kh_val(PAIR_INDEX, k) = PAIRS.n;
+    kv_push(ContactPair, PAIRS, pair);
+    contactLink(s, PAIRS.n - 1);
   }
+
+  PHYSICS.tick = h.tick;
+  PHYSICS.accumulator = h.accumulator;
+  PHYSICS.alpha = PHYSICS.accumulator / PHYSICS.tick_rate;
+
+  free(slot);
+  free(masks);
+  if (missing) {
+    log_warn("%u things in the physics state were deleted since", missing);
+    return Err;
+  }
+  return Ok;
+}
+
+/*
+ * ========
+ * @RAYCAST
+ * ========
+ *
+ * Scene queries against the broadphase tree, testing the live body boxes in
+ * the store. Safe to run from several threads at once, but not while a tick
+ * is running.
+ */
+
+typedef struct Raycast {
+  vec3 origin, magnitude, inv;
+  uint32_t filter;
+  int best;  // slot of the closest hit so far, -1 if none
+  float time;
+
+  // set for physicsRaycastAll
+  RayHit* all;
+  int n_all, max_all;
+} Raycast;
+
+static void raycastInit(Raycast* r, vec3 origin, vec3 dir, float max_dist,
+                        uint32_t filter) {
+  vec3 d;
+  glm_vec3_normalize_to(dir, d);
+
+  *r = (Raycast){.filter = filter, .best = -1, .time = 1.0f};
+  glm_vec3_copy(origin, r->origin);
+  glm_vec3_scale(d, max_dist, r->magnitude);
+  for (int i = 0; i < 3; i++) {
+    r->inv[i] = fabsf(r->magnitude[i]) > 1e-8f ? 1.0f / r->magnitude[i] : 1e30f;
+  }
+}
+
+// Slab test of the ray against slot i, within [0, tmax]. Returns the entry
+// time, or -1 for a miss.
+static inline float raycastBox(Raycast* r, BodyStore* s, int i, float tmax) {
+  float p[3] = {s->px[i], s->py[i], s->pz[i]};
+  float h[3] = {s->hx[i], s->hy[i], s->hz[i]};
+  float tmin = 0.0f;
+
+  for (int a = 0; a < 3; a++) {
+    float t1 = (p[a] - h[a] - r->origin[a]) * r->inv[a];
+    float t2 = (p[a] + h[a] - r->origin[a]) * r->inv[a];
+    tmin = MAX(tmin, MIN(t1, t2));
+    tmax = MIN(tmax, MAX(t1, t2));
+  }
+
+  return tmin <= tmax ? tmin : -1.0f;
+}
+
+static float raycastClosest(void* ctx, int leaf, void* data, float tmax) {
+  Raycast* r = ctx;
+  Thing* t = data;
+  if (!(r->filter & PHYSICS_FILTER(t->type))) return tmax;
+
+  float time = raycastBox(r, &BODIES, t->body_idx, tmax);
+  if (time < 0 || time >= r->time) return tmax;
+
+  r->best = t->body_idx;
+  r->time = time;
+  return time;  // nothing past here can be closer; 0 stops the walk
+}
+
+static float raycastEvery(void* ctx, int leaf, void* data, float tmax) {
+  Raycast* r = ctx;
+  Thing* t = data;
+  if (!(r->filter & PHYSICS_FILTER(t->type))) return tmax;
+
+  float time = raycastBox(r, &BODIES, t->body_idx, tmax);
+  if (time < 0) return tmax;
+
+  // keep the nearest max_all hits
+  int dst = r->n_all;
+  if (r->n_all == r->max_all) {
+    dst = 0;
+    for (int i = 1; i < r->n_all; i++) {
+      if (r->all[i].hit.time > r->all[dst].hit.time) dst = i;
+    }
+    if (!r->n_all || time >= r->all[dst].hit.time) return tmax;
+  } else {
+    r->n_all++;
+  }
+
+  r->all[dst].id = t->body_idx;  // slot for now, see raycastFinish
+  r->all[dst].hit.time = time;
+  return tmax;
+}
+
+// Fill in a hit on slot i at ray time t, and return the thing's id.
+static ThingId raycastFinish(Raycast* r, int i, float t, Hit* out) {
+  BodyStore* s = &BODIES;
+  float p[3] = {s->px[i], s->py[i], s->pz[i]};
+  float h[3] = {s->hx[i], s->hy[i], s->hz[i]};
+
+  *out = (Hit){.is_hit = true, .time = t * glm_vec3_norm(r->magnitude)};
+  for (int a = 0; a < 3; a++) {
+    out->pos[a] = r->origin[a] + r->magnitude[a] * t;
+  }
+
+  // the face we entered through is the one whose slab we entered last;
+  // starting inside the box gives no normal
+  int axis = -1;
+  float last = 0.0f;
+  for (int a = 0; a < 3; a++) {
+    float t1 = (p[a] - h[a] - r->origin[a]) * r->inv[a];
+    float t2 = (p[a] + h[a] - r->origin[a]) * r->inv[a];
+    if (fminf(t1, t2) > last) {
+      last = fminf(t1, t2);
+      axis = a;
+    }
+  }
+  if (axis != -1) out->normal[axis] = r->magnitude[axis] > 0 ? -1.0f : 1.0f;
+
+  return s->things[i]->id;
+}
+
+// Closest thing along the ray whose type passes the filter. Returns its id,
+// or THING_NULL if nothing was hit.
+ThingId physicsRaycast(vec3 origin, vec3 dir, float max_dist, uint32_t filter,
+                       Hit* out) {
+  Raycast r;
+  raycastInit(&r, origin, dir, max_dist, filter);
+  bvhQueryRay(&TREE, r.origin, r.magnitude, (vec3){0, 0, 0}, 1.0f,
+              raycastClosest, &r);
+
+  *out = (Hit){0};
+  if (r.best == -1) return THING_NULL;
+  return raycastFinish(&r, r.best, r.time, out);
+}
+
+// Up to max_out things along the ray, nearest first. Returns how many.
+int physicsRaycastAll(vec3 origin, vec3 dir, float max_dist, uint32_t filter,
+                      RayHit* out, int max_out) {
+  Raycast r;
+  raycastInit(&r, origin, dir, max_dist, filter);
+  r.all = out;
+  r.max_all = max_out;
+  bvhQueryRay(&TREE, r.origin, r.magnitude, (vec3){0, 0, 0}, 1.0f,
+              raycastEvery, &r);
+
+  // insertion sort; max_out is small
+  for (int i = 1; i < r.n_all; i++) {
+    RayHit h = out[i];
+    int j = i;
+    for (; j > 0 && out[j - 1].hit.time > h.hit.time; j--) out[j] = out[j - 1];
+    out[j] = h;
+  }
+
+  for (int i = 0; i < r.n_all; i++) {
+    out[i].id = raycastFinish(&r, out[i].id, out[i].hit.time, &out[i].hit);
+  }
+  return r.n_all;
+}
+
+typedef struct RaycastJob {
+  Ray* rays;
+  uint32_t filter;
+  RayHit* out;
+} RaycastJob;
+
+static void physicsRaycastJob(void* ctx, int start, int end) {
+  RaycastJob* job = ctx;
+  for (int i = start; i < end; i++) {
+    Ray* ray = &job->rays[i];
+    job->out[i].id = physicsRaycast(ray->origin, ray->dir, ray->max_dist,
+                                    job->filter, &job->out[i].hit);
+  }
+}
+
+// Closest hit for each of n rays, spread over the job pool.
+void physicsRaycastBatch(Ray* rays, int n, uint32_t filter, RayHit* out) {
+  RaycastJob job = {.rays = rays, .filter = filter, .out = out};
+  jobsParallelFor(physicsRaycastJob, &job, n, 64);
+}
+
+// Every thing whose fat box is at least partly inside the frustum, handed to
+// f as its Thing*.
+void physicsQueryFrustum(Frustum* fr, BvhQueryFunc f, void* ctx) {
+  bvhQueryFrustum(&TREE, fr, f, ctx);
 }
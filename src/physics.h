@@ -1,9 +1,132 @@
 #include "thing.h"
+#include "ecs.h"
+#include "bvh.h"
+
+// length of one physics tick, in seconds
+#define PHYSICS_TICK_RATE (1.0 / 60.0)
+
+// ticks allowed per frame before we give up on catching up
+#define PHYSICS_MAX_STEPS 4
+
+// mask words (64 bodies each) handed to a job at a time
+#define PHYSICS_JOB_WORDS 4
+
+// most times a sweep slides along what it hit in one tick
+#define PHYSICS_SLIDE_ITERATIONS 4
+
+// things a sweep keeps to re-test while sliding; a multiple of AABB_BATCH
+#define PHYSICS_SLIDE_CANDIDATES 32
+
+// bodies slower than this, in units per second, count as still
+#define PHYSICS_SLEEP_VELOCITY 0.05f
+
+// ticks every body in an island must be still before the island sleeps
+#define PHYSICS_SLEEP_TICKS 30
+
+// bodies closer than this count as touching, for islands and waking
+#define PHYSICS_CONTACT_MARGIN 0.01f
+
+enum {
+  CONTACT_BEGIN,  // first tick two things touch
+  CONTACT_STAY,   // every following tick they still touch
+  CONTACT_END,    // first tick they don't, or one of them was removed
+};
+
+typedef struct ContactEvent {
+  int type;
+  ThingId a, b;
+  vec3 normal;  // points from b towards a
+  int tick;
+} ContactEvent;
+
+typedef struct Physics {
+  double accumulator;  // time not yet simulated
+  double tick_rate;
+  int max_steps;
+  float alpha;  // fraction of a tick between the last update and now
+  int tick;     // ticks simulated so far
+
+  // Contact events from the ticks run by the last physicsAdvance. The buffer
+  // is reused every frame, so read it before the next one.
+  kvec_t(ContactEvent) events;
+} Physics;
+
+extern Physics PHYSICS;
+
+// Structure-of-arrays copy of every body, indexed by Thing.body_idx.
+typedef struct BodyStore {
+  float *px, *py, *pz;     // position
+  float *ppx, *ppy, *ppz;  // position as of the previous tick
+  float *vx, *vy, *vz;     // velocity
+  float *hx, *hy, *hz;     // halfsize
+  uint64_t* dynamic;       // bitmask of dynamic bodies
+  uint64_t* grounded;      // bitmask of grounded bodies
+  uint64_t* awake;         // bitmask of bodies being simulated
+  uint8_t* still;          // ticks spent below PHYSICS_SLEEP_VELOCITY
+  uint8_t* landed;         // per-tick scratch: sweep hit a floor
+  int* hit;                // per-tick scratch: slot the sweep stopped at
+  int8_t* hit_axis;        // per-tick scratch: +-(axis + 1) of the hit normal
+  int* island;             // per-tick scratch: union-find parent
+  uint8_t* restless;       // per-tick scratch: island has a moving body
+  int* contacts;           // first contact pair of each slot, -1 for none
+  Thing** things;          // owner of each slot
+  int n, cap;
+} BodyStore;
+
+extern BodyStore BODIES;
+
+void physicsInit();
+void physicsAddThing(Thing* t);
+void physicsAddThings(Thing** things, int n);
+void physicsRemoveThing(Thing* t);
+void physicsPushBody(Thing* t);
+void physicsWakeThing(Thing* t);
+
 // update all bodies in the physics system
-void physicsUpdate(kh_thing_t* things, double delta_time);
+void physicsUpdate(double delta_time);
+int physicsAdvance(double frame_delta);
+void physicsInterpolate(Transform* tr, vec3 dest);
+
+// save and load the simulation, see @STATE in physics.c
+size_t physicsStateSize();
+void physicsSaveState(uint32_t* dest);
+Result physicsLoadState(const uint32_t* src, size_t n_words);
+
+// Raycast filters: a bit per thing type.
+#define PHYSICS_FILTER(type) (1u << (type))
+#define PHYSICS_FILTER_ALL 0xffffffffu
+
+typedef struct Ray {
+  vec3 origin, dir;
+  float max_dist;
+} Ray;
+
+typedef struct RayHit {
+  ThingId id;  // THING_NULL for a miss
+  Hit hit;     // hit.time is the distance along the ray
+} RayHit;
+
+ThingId physicsRaycast(vec3 origin, vec3 dir, float max_dist, uint32_t filter,
+                       Hit* out);
+int physicsRaycastAll(vec3 origin, vec3 dir, float max_dist, uint32_t filter,
+                      RayHit* out, int max_out);
+void physicsRaycastBatch(Ray* rays, int n, uint32_t filter, RayHit* out);
+void physicsQueryFrustum(Frustum* fr, BvhQueryFunc f, void* ctx);
+
+// boxes tested per call to aabbIntersectRayBatch
+#define AABB_BATCH 8
+
+// Boxes for aabbIntersectRayBatch, laid out so each axis loads in one go.
+typedef struct AABBBatch {
+  float minx[AABB_BATCH], miny[AABB_BATCH], minz[AABB_BATCH];
+  float maxx[AABB_BATCH], maxy[AABB_BATCH], maxz[AABB_BATCH];
+  int idx[AABB_BATCH];  // caller's id for each box
+  int n;
+} AABBBatch;
 
 void aabbMinMax(Body* b, vec3 min, vec3 max);
 void aabbMinkowskiDifference(Body* a, Body* b, Body* dest);
 void aabbNew(vec3* vertices, int n, Body* body);
 bool aabbCollide(Body* a, Body* b);
 Hit aabbIntersectRay(vec3 pos, vec3 magnitude, Body* body);
+Hit aabbIntersectRayBatch(vec3 pos, vec3 magnitude, AABBBatch* b, int* index);
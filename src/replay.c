@@ -0,0 +1,171 @@
+#include "replay.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "physics.h"
+#include "utils.h"
+
+_Static_assert(sizeof(ReplayFrame) == 32, "replay frame layout changed");
+_Static_assert(sizeof(ReplayBody) == 24, "replay body layout changed");
+_Static_assert(sizeof(ReplayHeader) % 8 == 0, "replay header layout changed");
+
+// Start recording to path. scene is whatever the session loaded on top of the
+// default things, so a replay can load it too.
+Result replayRecord(Replay* r, const char* path, const char* scene, int resx,
+                    int resy) {
+  *r = (Replay){0};
+  if (scene && strlen(scene) >= sizeof(r->header.scene)) {
+    log_error("scene name too long to record: %s", scene);
+    return Err;
+  }
+
+  r->out = fopen(path, "wb");
+  if (!r->out) {
+    log_error("failed to open %s to record to", path);
+    return Err;
+  }
+
+  r->header = (ReplayHeader){.magic = REPLAY_MAGIC,
+                             .version = REPLAY_VERSION,
+                             .resx = resx,
+                             .resy = resy,
+                             .frames_offset = sizeof(ReplayHeader)};
+  if (scene) strcpy(r->header.scene, scene);
+
+  // written again with the counts by replayFinish
+  fwrite(&r->header, sizeof(r->header), 1, r->out);
+  return Ok;
+}
+
+void replayRecordFrame(Replay* r, ReplayFrame* frame) {
+  if (!r->out) return;
+  fwrite(frame, sizeof(*frame), 1, r->out);
+  r->header.n_frames++;
+}
+
+// Write where every body is now and close the recording.
+Result replayFinish(Replay* r) {
+  if (!r->out) return Err;
+
+  ReplayBody* bodies = malloc(sizeof(ReplayBody) * (BODIES.n + 1));
+  if (!bodies) {
+    log_error("failed to allocate %d bodies to record", BODIES.n);
+    exit(1);
+  }
+  for (int i = 0; i < BODIES.n; i++) {
+    bodies[i] = (ReplayBody){.id = BODIES.things[i]->id,
+                             .pos = {BODIES.px[i], BODIES.py[i], BODIES.pz[i]}};
+  }
+
+  r->header.n_bodies = BODIES.n;
+  r->header.bodies_offset =
+      r->header.frames_offset + sizeof(ReplayFrame) * r->header.n_frames;
+
+  Result ret = Ok;
+  if (fwrite(bodies, sizeof(ReplayBody), BODIES.n, r->out) != BODIES.n ||
+      fseek(r->out, 0, SEEK_SET) ||
+      fwrite(&r->header, sizeof(r->header), 1, r->out) != 1 ||
+      ferror(r->out)) {
+    ret = Err;
+  }
+  if (fclose(r->out)) ret = Err;
+  r->out = NULL;
+  free(bodies);
+
+  if (ret == Ok) {
+    log_info("recorded %u frames and %u bodies", r->header.n_frames,
+             r->header.n_bodies);
+  } else {
+    log_error("failed to write the recording");
+  }
+  return ret;
+}
+
+Result replayLoad(Replay* r, const char* path) {
+  *r = (Replay){0};
+
+  FILE* f = fopen(path, "rb");
+  if (!f) {
+    log_error("failed to open replay %s", path);
+    return Err;
+  }
+  fseek(f, 0, SEEK_END);
+  long size = ftell(f);
+  fseek(f, 0, SEEK_SET);
+  if (size < 0) size = 0;
+
+  r->data = malloc(size + 1);
+  if (!r->data) {
+    log_error("failed to allocate %ld bytes for replay %s", size, path);
+    exit(1);
+  }
+  if (fread(r->data, 1, size, f) != (size_t)size) {
+    log_error("failed to read replay %s", path);
+    fclose(f);
+    replayFree(r);
+    return Err;
+  }
+  fclose(f);
+
+  ReplayHeader* h = (ReplayHeader*)r->data;
+  if (size < sizeof(ReplayHeader) || memcmp(h->magic, REPLAY_MAGIC, 4)) {
+    log_error("%s is not a replay", path);
+    replayFree(r);
+    return Err;
+  }
+  if (h->version != REPLAY_VERSION) {
+    log_error("%s is replay version %u, expected %u", path, h->version,
+              REPLAY_VERSION);
+    replayFree(r);
+    return Err;
+  }
+  // written so that no offset in a corrupt file can overflow it
+  uint64_t end = size;
+  if (h->frames_offset > end ||
+      h->n_frames > (end - h->frames_offset) / sizeof(ReplayFrame) ||
+      h->bodies_offset > end ||
+      h->n_bodies > (end - h->bodies_offset) / sizeof(ReplayBody) ||
+      h->frames_offset % 8 || h->bodies_offset % 8 ||
+      !memchr(h->scene, 0, sizeof(h->scene))) {
+    log_error("%s is truncated or corrupt", path);
+    replayFree(r);
+    return Err;
+  }
+
+  r->header = *h;
+  r->frames = (ReplayFrame*)(r->data + h->frames_offset);
+  r->bodies = (ReplayBody*)(r->data + h->bodies_offset);
+  return Ok;
+}
+
+// Count the recorded bodies that aren't where the recording left them, or are
+// gone. max_error gets the furthest any of them is off by on an axis.
+uint32_t replayCompare(Replay* r, float* max_error) {
+  uint32_t wrong = 0;
+  *max_error = 0;
+
+  for (uint32_t i = 0; i < r->header.n_bodies; i++) {
+    ReplayBody* b = &r->bodies[i];
+    Thing* t = thingGet(b->id);
+    if (!t || t->body_idx < 0) {
+      wrong++;
+      continue;
+    }
+
+    float now[3] = {BODIES.px[t->body_idx], BODIES.py[t->body_idx],
+                    BODIES.pz[t->body_idx]};
+    float error = 0;
+    for (int k = 0; k < 3; k++) error = MAX(error, fabsf(now[k] - b->pos[k]));
+    *max_error = MAX(*max_error, error);
+    wrong += memcmp(now, b->pos, sizeof(now)) != 0;
+  }
+
+  wrong += BODIES.n > r->header.n_bodies ? BODIES.n - r->header.n_bodies : 0;
+  return wrong;
+}
+
+void replayFree(Replay* r) {
+  if (r->out) fclose(r->out);
+  free(r->data);
+  *r = (Replay){0};
+}
@@ -0,0 +1,66 @@
+#ifndef GAME_REPLAY
+#define GAME_REPLAY
+#include <stdint.h>
+#include <stdio.h>
+#include "log.h"
+#include "thing.h"
+
+/*
+ * =======
+ * @REPLAY
+ * =======
+ *
+ * Recordings of a play session: the input and frame time of every frame, and
+ * where every body ended up. Feeding the frames back in from the same start
+ * runs the same ticks on the same input, so a replay must end with the bodies
+ * in the same places. That makes recordings regression tests and repeatable
+ * benchmarks.
+ *
+ * Layout: a ReplayHeader, then n_frames ReplayFrames at frames_offset, then
+ * n_bodies ReplayBodies at bodies_offset. Numbers are in host byte order.
+ */
+
+#define REPLAY_MAGIC "RPLY"
+#define REPLAY_VERSION 1
+
+// Input as the game sees it at the start of a frame.
+typedef struct ReplayFrame {
+  double delta;  // seconds since the previous frame
+  double mouse_x, mouse_y;
+  uint32_t keys;     // bit per pressed keybinding
+  uint32_t buttons;  // bit per pressed mouse binding
+} ReplayFrame;
+
+typedef struct ReplayBody {
+  ThingId id;
+  float pos[3];
+  uint32_t pad;
+} ReplayBody;
+
+typedef struct ReplayHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t n_frames;
+  uint32_t n_bodies;
+  int32_t resx, resy;  // window size, for the camera and picking
+  uint64_t frames_offset;
+  uint64_t bodies_offset;
+  char scene[256];  // what was loaded on top of the default things, or ""
+} ReplayHeader;
+
+typedef struct Replay {
+  ReplayHeader header;
+  FILE* out;            // while recording
+  char* data;           // the whole file, while replaying
+  ReplayFrame* frames;  // into data
+  ReplayBody* bodies;   // into data
+} Replay;
+
+Result replayRecord(Replay* r, const char* path, const char* scene, int resx,
+                    int resy);
+void replayRecordFrame(Replay* r, ReplayFrame* frame);
+Result replayFinish(Replay* r);
+Result replayLoad(Replay* r, const char* path);
+uint32_t replayCompare(Replay* r, float* max_error);
+void replayFree(Replay* r);
+#endif
@@ -0,0 +1,245 @@
+#include "scene.h"
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ecs.h"
+
+#define SCENE_ALIGN(n) (((n) + 15) & ~(uint64_t)15)
+
+static inline bool hostIsLittleEndian() {
+  uint32_t one = 1;
+  return *(uint8_t*)&one == 1;
+}
+
+static void sceneThingFrom(Thing* t, SceneThing* st) {
+  Entity e = THING_INDEX(t->id);
+  Transform* tr = ecsGet(COMP_TRANSFORM, e);
+  Velocity* v = ecsGet(COMP_VELOCITY, e);
+  Collider* c = ecsGet(COMP_COLLIDER, e);
+
+  *st = (SceneThing){.type = t->type, .color = SCENE_NONE};
+  memcpy(st->pos, tr->pos, sizeof(st->pos));
+  memcpy(st->rot, tr->rot, sizeof(st->rot));
+  memcpy(st->scale, tr->scale, sizeof(st->scale));
+  memcpy(st->halfsize, c->halfsize, sizeof(st->halfsize));
+  memcpy(st->velocity, v->linear, sizeof(st->velocity));
+  st->mass = c->mass;
+  st->is_dynamic = c->is_dynamic;
+  st->is_grounded = c->is_grounded;
+}
+
+// Write things to path. Things whose data can't be stored, like models, are
+// left out.
+Result sceneSaveThings(const char* path, Thing** list, uint32_t count) {
+  if (!hostIsLittleEndian()) {
+    log_error("scene files can only be written on little-endian hosts");
+    return Err;
+  }
+
+  SceneThing* things = malloc(sizeof(SceneThing) * (count + 1));
+  float(*colors)[4] = malloc(sizeof(float[4]) * (count + 1));
+  if (!things || !colors) {
+    log_error("failed to allocate %u things to save", count);
+    exit(1);
+  }
+
+  uint32_t n = 0, n_colors = 0, skipped = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    Thing* t = list[i];
+    if (t->type == THING_BACKPACK) {
+      skipped++;
+      continue;
+    }
+
+    SceneThing* st = &things[n++];
+    sceneThingFrom(t, st);
+
+    Material* m = ecsGet(COMP_MATERIAL, THING_INDEX(t->id));
+    if (m) {
+      memcpy(colors[n_colors], m->color, sizeof(colors[0]));
+      st->color = n_colors++;
+    }
+  }
+
+  SceneHeader h = {.magic = SCENE_MAGIC,
+                   .version = SCENE_VERSION,
+                   .n_things = n,
+                   .n_colors = n_colors,
+                   .things_offset = sizeof(SceneHeader)};
+  h.colors_offset = SCENE_ALIGN(h.things_offset + sizeof(SceneThing) * n);
+  size_t pad = h.colors_offset - (h.things_offset + sizeof(SceneThing) * n);
+
+  Result ret = Ok;
+  FILE* f = fopen(path, "wb");
+  if (!f || fwrite(&h, sizeof(h), 1, f) != 1 ||
+      fwrite(things, sizeof(SceneThing), n, f) != n ||
+      fwrite((char[16]){0}, 1, pad, f) != pad ||
+      fwrite(colors, sizeof(colors[0]), n_colors, f) != n_colors) {
+    log_error("failed to write scene to %s", path);
+    ret = Err;
+  }
+  if (f && fclose(f)) ret = Err;
+
+  if (skipped) {
+    log_warn("left %u things without saveable data out of %s", skipped, path);
+  }
+  if (ret == Ok) log_info("saved %u things to %s", n, path);
+
+  free(things);
+  free(colors);
+  return ret;
+}
+
+// Write every live thing to path.
+Result sceneSave(const char* path) {
+  return sceneSaveThings(path, THINGS.dense, THINGS.n);
+}
+
+// Whether n records of record bytes at offset fit in size bytes. Written so
+// that no offset in a corrupt file can overflow it.
+static inline bool sceneFits(uint64_t offset, uint64_t n, size_t record,
+                             size_t size) {
+  return offset <= size && n <= (size - offset) / record;
+}
+
+static Result sceneCheckHeader(SceneHeader* h, size_t size, const char* path) {
+  if (size < sizeof(SceneHeader) || memcmp(h->magic, SCENE_MAGIC, 4)) {
+    log_error("%s is not a scene file", path);
+    return Err;
+  }
+  if (h->version != SCENE_VERSION) {
+    log_error("%s is scene version %u, expected %u", path, h->version,
+              SCENE_VERSION);
+    return Err;
+  }
+
+  if (h->things_offset % 4 || h->colors_offset % 16 ||
+      !sceneFits(h->things_offset, h->n_things, sizeof(SceneThing), size) ||
+      !sceneFits(h->colors_offset, h->n_colors, sizeof(float[4]), size)) {
+    log_error("%s is truncated or corrupt", path);
+    return Err;
+  }
+
+  return Ok;
+}
+
+// Map a scene file and check it, without adding anything. Safe to call from
+// any thread, e.g. to load ahead in the background.
+Result sceneOpen(Scene* scene, const char* path) {
+  *scene = (Scene){0};
+  if (!hostIsLittleEndian()) {
+    log_error("scene files can only be read on little-endian hosts");
+    return Err;
+  }
+
+  int fd = open(path, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st)) {
+    log_error("failed to open scene %s", path);
+    if (fd >= 0) close(fd);
+    return Err;
+  }
+
+  // populate up front, so the caller never waits on the disk after this
+  size_t size = st.st_size;
+  void* map = size ? mmap(NULL, size, PROT_READ, MAP_PRIVATE | MAP_POPULATE,
+                          fd, 0)
+                   : NULL;
+  close(fd);
+  if (map == MAP_FAILED || !map) {
+    log_error("failed to map scene %s", path);
+    return Err;
+  }
+
+  SceneHeader* h = map;
+  if (is_err(sceneCheckHeader(h, size, path))) {
+    munmap(map, size);
+    return Err;
+  }
+
+  *scene = (Scene){.map = map, .size = size, .n_things = h->n_things};
+  return Ok;
+}
+
+// Add the things of an opened scene. Their ids are written to ids if it isn't
+// NULL. The colors stay in the mapping, which the things' data points at.
+Result sceneAddThings(Scene* scene, ThingId* ids) {
+  SceneHeader* h = scene->map;
+  SceneThing* records = (SceneThing*)((char*)scene->map + h->things_offset);
+  vec4* colors = (vec4*)((char*)scene->map + h->colors_offset);
+  Thing** things = malloc(sizeof(Thing*) * (h->n_things + 1));
+  if (!things) {
+    log_error("failed to allocate %u things for a scene", h->n_things);
+    exit(1);
+  }
+
+  // things are copied from one prefab per type rather than set up one by one,
+  // since the file has their halfsizes
+  Prefab prefabs[THING_TYPE_COUNT];
+  Body unit = {.scale = {1, 1, 1}};
+  for (int type = 0; type < THING_TYPE_COUNT; type++) {
+    if (type != THING_BACKPACK) prefabInit(&prefabs[type], NULL, type, &unit);
+  }
+
+  // the fix-up pass: color indices become pointers into the mapping
+  uint32_t n = 0;
+  for (; n < h->n_things; n++) {
+    SceneThing* r = &records[n];
+    if (r->type >= THING_TYPE_COUNT || r->type == THING_BACKPACK ||
+        (r->color != SCENE_NONE && r->color >= h->n_colors)) {
+      log_error("scene thing %u is corrupt", n);
+      break;
+    }
+
+    Thing* t = poolAlloc(&THINGS.pool);
+    if (!t) {
+      log_error("failed to allocate scene thing %u", n);
+      break;
+    }
+    *t = prefabs[r->type].like;
+    t->self = r->color == SCENE_NONE ? NULL : colors[r->color];
+
+    Body* b = &t->body;
+    memcpy(b->pos, r->pos, sizeof(b->pos));
+    memcpy(b->rot, r->rot, sizeof(b->rot));
+    memcpy(b->scale, r->scale, sizeof(b->scale));
+    memcpy(b->halfsize, r->halfsize, sizeof(b->halfsize));
+    memcpy(b->velocity, r->velocity, sizeof(b->velocity));
+    b->mass = r->mass;
+    b->is_dynamic = r->is_dynamic;
+    b->is_grounded = r->is_grounded;
+    things[n] = t;
+  }
+
+  if (n < h->n_things || is_err(thingsAddBatch(things, n))) {
+    for (uint32_t i = 0; i < n; i++) poolFree(&THINGS.pool, things[i]);
+    free(things);
+    return Err;
+  }
+
+  if (ids) {
+    for (uint32_t i = 0; i < n; i++) ids[i] = things[i]->id;
+  }
+  free(things);
+  return Ok;
+}
+
+Result sceneLoad(Scene* scene, const char* path) {
+  if (is_err(sceneOpen(scene, path))) return Err;
+
+  if (is_err(sceneAddThings(scene, NULL))) {
+    sceneUnload(scene);
+    return Err;
+  }
+
+  log_info("loaded %u things from %s", scene->n_things, path);
+  return Ok;
+}
+
+void sceneUnload(Scene* scene) {
+  if (scene->map) munmap(scene->map, scene->size);
+  *scene = (Scene){0};
+}
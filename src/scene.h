@@ -0,0 +1,62 @@
+#ifndef GAME_SCENE
+#define GAME_SCENE
+#include <stddef.h>
+#include <stdint.h>
+#include "log.h"
+#include "thing.h"
+
+/*
+ * ======
+ * @SCENE
+ * ======
+ *
+ * Binary scene files. All numbers are little-endian and every record has a
+ * fixed size, so a file is loaded by mapping it and making one pass over the
+ * things to turn color indices into pointers into the mapping.
+ *
+ * Layout: a SceneHeader, then n_things SceneThings at things_offset, then
+ * n_colors colors (4 floats each) at colors_offset.
+ */
+
+#define SCENE_MAGIC "SCNE"
+#define SCENE_VERSION 1
+
+// color index of things without one
+#define SCENE_NONE UINT32_MAX
+
+typedef struct SceneHeader {
+  char magic[4];
+  uint32_t version;
+  uint32_t n_things;
+  uint32_t n_colors;
+  uint64_t things_offset;  // from the start of the file
+  uint64_t colors_offset;  // 16-byte aligned, colors are loaded as vec4s
+} SceneHeader;
+
+typedef struct SceneThing {
+  uint32_t type;
+  uint32_t color;  // index in the color table, or SCENE_NONE
+  float pos[3], rot[3], scale[3], halfsize[3], velocity[3];
+  float mass;
+  uint8_t is_dynamic, is_grounded;
+  uint8_t pad[2];
+} SceneThing;
+
+_Static_assert(sizeof(SceneHeader) == 32, "scene header layout changed");
+_Static_assert(sizeof(SceneThing) == 76, "scene thing layout changed");
+
+// A loaded scene file. Its things point into the mapping, so keep it until
+// they are deleted.
+typedef struct Scene {
+  void* map;
+  size_t size;
+  uint32_t n_things;
+} Scene;
+
+Result sceneSave(const char* path);
+Result sceneSaveThings(const char* path, Thing** things, uint32_t n);
+Result sceneOpen(Scene* scene, const char* path);
+Result sceneAddThings(Scene* scene, ThingId* ids);
+Result sceneLoad(Scene* scene, const char* path);
+void sceneUnload(Scene* scene);
+#endif
@@ -0,0 +1,203 @@
+#include "snapshot.h"
+#include <stdlib.h>
+#include <string.h>
+#include "physics.h"
+#include "thing.h"
+#include "utils.h"
+
+static void wordsReserve(SnapshotWords* words, size_t n) {
+  if (words->m >= n) return;
+
+  size_t m = MAX(n, words->m * 2);
+  kv_resize(uint32_t, *words, m);
+  if (!words->a) {
+    log_error("failed to allocate a %zu word snapshot", n);
+    exit(1);
+  }
+}
+
+// Save the simulation as it is now.
+void snapshotTake(Snapshot* s) {
+  size_t n = physicsStateSize();
+  wordsReserve(&s->words, n);
+  physicsSaveState(s->words.a);
+  s->words.n = n;
+  s->tick = PHYSICS.tick;
+}
+
+// Put the simulation back how it was when s was taken.
+Result snapshotRestore(Snapshot* s) {
+  if (!s->words.n) {
+    log_error("restoring a snapshot that was never taken");
+    return Err;
+  }
+  return physicsLoadState(s->words.a, s->words.n);
+}
+
+void snapshotFree(Snapshot* s) {
+  kv_destroy(s->words);
+  *s = (Snapshot){0};
+}
+
+/*
+ * =======
+ * @DELTAS
+ * =======
+ */
+
+// Encode older into d as its difference to newer. Overwrites older's words.
+static void deltaEncode(SnapshotDelta* d, Snapshot* older, Snapshot* newer) {
+  size_t n = MAX(older->words.n, newer->words.n);
+  wordsReserve(&older->words, n);
+  uint32_t* x = older->words.a;
+  memset(x + older->words.n, 0, sizeof(uint32_t) * (n - older->words.n));
+
+  size_t changed = 0;
+  for (size_t i = 0; i < newer->words.n; i++) {
+    x[i] ^= newer->words.a[i];
+    changed += x[i] != 0;
+  }
+  for (size_t i = newer->words.n; i < n; i++) changed += x[i] != 0;
+
+  // sized to fit, so a ring of small deltas stays small. The loop below
+  // stores every word before deciding to keep it, so one more than fits.
+  size_t mask_words = (n + 31) / 32;
+  size_t size = mask_words + changed;
+  if (d->encoded.m < size + 1 || d->encoded.m > 2 * (size + 1)) {
+    kv_resize(uint32_t, d->encoded, size + 1);
+    if (!d->encoded.a) {
+      log_error("failed to allocate a %zu word snapshot delta", size);
+      exit(1);
+    }
+  }
+
+  uint32_t* mask = d->encoded.a;
+  uint32_t* out = mask + mask_words;
+  memset(mask, 0, sizeof(uint32_t) * mask_words);
+  for (size_t i = 0, k = 0; i < n; i++) {
+    out[k] = x[i];
+    k += x[i] != 0;
+    mask[i >> 5] |= (uint32_t)(x[i] != 0) << (i & 31);
+  }
+
+  d->tick = older->tick;
+  d->n_words = older->words.n;
+  d->encoded.n = size;
+}
+
+// Turn s, the snapshot after d, into the one d was encoded from.
+static void deltaApply(SnapshotDelta* d, Snapshot* s) {
+  size_t n = MAX(s->words.n, d->n_words);
+  wordsReserve(&s->words, n);
+  memset(s->words.a + s->words.n, 0, sizeof(uint32_t) * (n - s->words.n));
+
+  size_t mask_words = (n + 31) / 32;
+  const uint32_t* mask = d->encoded.a;
+  const uint32_t* x = mask + mask_words;
+  uint32_t* w = s->words.a;
+  for (size_t m = 0; m < mask_words; m++) {
+    for (uint32_t bits = mask[m]; bits; bits &= bits - 1) {
+      w[(m << 5) + __builtin_ctz(bits)] ^= *x++;
+    }
+  }
+
+  s->words.n = d->n_words;
+  s->tick = d->tick;
+}
+
+/*
+ * =====
+ * @RING
+ * =====
+ */
+
+// Keep the last capacity snapshots.
+void snapshotRingInit(SnapshotRing* r, int capacity) {
+  *r = (SnapshotRing){.cap = MAX(capacity - 1, 0)};
+  r->deltas = calloc(r->cap + 1, sizeof(SnapshotDelta));
+  if (!r->deltas) {
+    log_error("failed to allocate a ring of %d snapshots", capacity);
+    exit(1);
+  }
+}
+
+// Take a snapshot, dropping the oldest one if the ring is full. Things deleted
+// from the oldest snapshot's tick on are kept, so rewinding can revive them.
+void snapshotRingPush(SnapshotRing* r) {
+  snapshotTake(&r->scratch);
+
+  if (r->newest.words.n && r->cap) {
+    int slot = (r->first + r->n) % r->cap;
+    if (r->n == r->cap) {
+      r->first = (r->first + 1) % r->cap;
+      r->n--;
+    }
+    deltaEncode(&r->deltas[slot], &r->newest, &r->scratch);
+    r->n++;
+  }
+
+  Snapshot tmp = r->newest;
+  r->newest = r->scratch;
+  r->scratch = tmp;
+
+  thingsKeepDeleted(r->n ? r->deltas[r->first].tick : r->newest.tick);
+}
+
+// Restore the snapshot of a tick and forget every snapshot after it, since
+// they are about to be simulated again.
+Result snapshotRingRewind(SnapshotRing* r, int tick) {
+  if (!r->newest.words.n) {
+    log_error("rewinding an empty snapshot ring");
+    return Err;
+  }
+
+  int back = 0;  // deltas to undo, newest first
+  if (tick != r->newest.tick) {
+    while (back < r->n &&
+           r->deltas[(r->first + r->n - 1 - back) % r->cap].tick != tick) {
+      back++;
+    }
+    if (back == r->n) {
+      log_error("no snapshot of tick %d to rewind to", tick);
+      return Err;
+    }
+    back++;
+  }
+
+  if (back) {
+    Snapshot* s = &r->scratch;
+    wordsReserve(&s->words, r->newest.words.n);
+    memcpy(s->words.a, r->newest.words.a,
+           sizeof(uint32_t) * r->newest.words.n);
+    s->words.n = r->newest.words.n;
+
+    for (int i = 0; i < back; i++) {
+      deltaApply(&r->deltas[(r->first + r->n - 1) % r->cap], s);
+      r->n--;
+    }
+
+    Snapshot tmp = r->newest;
+    r->newest = r->scratch;
+    r->scratch = tmp;
+  }
+
+  return snapshotRestore(&r->newest);
+}
+
+// Memory the ring's snapshots take up.
+size_t snapshotRingBytes(SnapshotRing* r) {
+  size_t words = r->newest.words.n;
+  for (int i = 0; i < r->n; i++) {
+    words += r->deltas[(r->first + i) % r->cap].encoded.n;
+  }
+  return sizeof(uint32_t) * words;
+}
+
+void snapshotRingFree(SnapshotRing* r) {
+  thingsKeepDeleted(THINGS_KEEP_NONE);
+  for (int i = 0; i < r->cap; i++) kv_destroy(r->deltas[i].encoded);
+  free(r->deltas);
+  snapshotFree(&r->newest);
+  snapshotFree(&r->scratch);
+  *r = (SnapshotRing){0};
+}
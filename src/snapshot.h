@@ -0,0 +1,56 @@
+#ifndef GAME_SNAPSHOT
+#define GAME_SNAPSHOT
+#include <stddef.h>
+#include <stdint.h>
+#include "kvec.h"
+#include "log.h"
+
+/*
+ * =========
+ * @SNAPSHOT
+ * =========
+ *
+ * Saved simulation states to rewind to, for replays and prediction. A snapshot
+ * is one buffer holding everything physicsSaveState writes: every body, the
+ * thing in each body slot, contacts and the tick.
+ *
+ * A SnapshotRing keeps the last few snapshots. Only the newest is kept whole;
+ * every older one is stored as the difference to the one after it: the words
+ * that changed, XORed with the newer ones, and a bit per word saying which
+ * did. Bodies that didn't move, asleep or static, cost a few bits, so a ring of
+ * a few seconds of ticks stays small. Rewinding to a snapshot undoes the
+ * differences back to it. While a ring is in use, deleted things are kept
+ * until its oldest snapshot is newer than them, so rewinding revives them.
+ */
+
+typedef kvec_t(uint32_t) SnapshotWords;
+
+typedef struct Snapshot {
+  int tick;
+  SnapshotWords words;
+} Snapshot;
+
+// A snapshot stored as the difference to the next newer one.
+typedef struct SnapshotDelta {
+  int tick;
+  size_t n_words;         // size of the snapshot once decoded
+  SnapshotWords encoded;  // changed-word bitmask, then the changed words
+} SnapshotDelta;
+
+typedef struct SnapshotRing {
+  Snapshot newest;
+  Snapshot scratch;
+  SnapshotDelta* deltas;  // older snapshots, oldest at first
+  int first, n, cap;
+} SnapshotRing;
+
+void snapshotTake(Snapshot* s);
+Result snapshotRestore(Snapshot* s);
+void snapshotFree(Snapshot* s);
+
+void snapshotRingInit(SnapshotRing* r, int capacity);
+void snapshotRingPush(SnapshotRing* r);
+Result snapshotRingRewind(SnapshotRing* r, int tick);
+size_t snapshotRingBytes(SnapshotRing* r);
+void snapshotRingFree(SnapshotRing* r);
+#endif
@@ -1,8 +1,10 @@
 #include "thing.h"
+#include <string.h>
 #include "utils.h"
 #include "log.h"
 #include "mesh.h"
 #include "physics.h"
+#include "ecs.h"
 
 /*
  * ===============
@@ -10,13 +12,119 @@
  * =============
  */
 
-Things THINGS = {0};
+// The pool is set up statically since things get loaded before thingsInit.
+Things THINGS = {.pool = POOL_INIT(sizeof(Thing), THINGS_POOL_CHUNK),
+                 .level = ARENA_INIT(THINGS_LEVEL_CHUNK)};
 
 // Initialize the thing manager
 void thingsInit() {
-  THINGS.things = kh_init_thing();
-  THINGS.curid = 0;
+  THINGS.n = THINGS.n_slots = 0;
+  THINGS.free = THING_NO_SLOT;
+  THINGS.graves.n = 0;
+  THINGS.keep_since = THINGS_KEEP_NONE;
   THINGS.init = 1;
+  physicsInit();
+}
+
+static void thingsGrow() {
+  THINGS.cap = THINGS.cap ? THINGS.cap * 2 : 256;
+  THINGS.dense = realloc(THINGS.dense, sizeof(Thing*) * THINGS.cap);
+  THINGS.dense_slot =
+      realloc(THINGS.dense_slot, sizeof(uint32_t) * THINGS.cap);
+
+  if (!THINGS.dense || !THINGS.dense_slot) {
+    log_error("failed to grow thing manager to %u things", THINGS.cap);
+    exit(1);
+  }
+}
+
+// Take a slot off the free list, or make a new one.
+static uint32_t thingsAllocSlot() {
+  if (THINGS.free != THING_NO_SLOT) {
+    uint32_t slot = THINGS.free;
+    THINGS.free = THINGS.slots[slot].dense;
+    return slot;
+  }
+
+  if (THINGS.n_slots == THINGS.slot_cap) {
+    THINGS.slot_cap = THINGS.slot_cap ? THINGS.slot_cap * 2 : 256;
+    THINGS.slots = realloc(THINGS.slots, sizeof(ThingSlot) * THINGS.slot_cap);
+    if (!THINGS.slots) {
+      log_error("failed to grow thing slots to %u", THINGS.slot_cap);
+      exit(1);
+    }
+  }
+
+  THINGS.slots[THINGS.n_slots].generation = 1;
+  return THINGS.n_slots++;
+}
+
+Thing* thingGet(ThingId id) {
+  uint32_t slot = THING_INDEX(id);
+  if (slot >= THINGS.n_slots) return NULL;
+
+  ThingSlot* s = &THINGS.slots[slot];
+  if (s->generation != THING_GENERATION(id)) return NULL;
+  return THINGS.dense[s->dense];
+}
+
+// The live thing in a slot, e.g. the owner of an entity's components.
+Thing* thingAt(uint32_t slot) { return THINGS.dense[THINGS.slots[slot].dense]; }
+
+static void thingListAdd(ThingList* l, uint32_t slot) {
+  if (slot >= l->n_where) {
+    uint32_t n = l->n_where ? l->n_where : 256;
+    while (n <= slot) n *= 2;
+    l->where = realloc(l->where, sizeof(uint32_t) * n);
+    if (!l->where) {
+      log_error("failed to grow thing list to %u slots", n);
+      exit(1);
+    }
+    memset(l->where + l->n_where, 0xff, sizeof(uint32_t) * (n - l->n_where));
+    l->n_where = n;
+  }
+  if (l->where[slot] != THING_NO_SLOT) return;
+
+  if (l->n == l->cap) {
+    l->cap = l->cap ? l->cap * 2 : 256;
+    l->slots = realloc(l->slots, sizeof(uint32_t) * l->cap);
+    if (!l->slots) {
+      log_error("failed to grow thing list to %u things", l->cap);
+      exit(1);
+    }
+  }
+
+  l->where[slot] = l->n;
+  l->slots[l->n++] = slot;
+}
+
+static void thingListRemove(ThingList* l, uint32_t slot) {
+  if (slot >= l->n_where || l->where[slot] == THING_NO_SLOT) return;
+
+  uint32_t i = l->where[slot];
+  l->slots[i] = l->slots[--l->n];
+  l->where[l->slots[i]] = i;
+  l->where[slot] = THING_NO_SLOT;
+}
+
+// Put t, whose id names slot, in that slot and build its components.
+static void thingsPlace(Thing* t, uint32_t slot) {
+  if (THINGS.n == THINGS.cap) thingsGrow();
+
+  THINGS.slots[slot].dense = THINGS.n;
+  THINGS.dense[THINGS.n] = t;
+  THINGS.dense_slot[THINGS.n] = slot;
+  THINGS.n++;
+
+  ecsAddThing(t);
+  thingListAdd(&THINGS.types[t->type], slot);
+}
+
+// Give t a slot and an id, and build its components.
+static void thingsInsert(Thing* t) {
+  uint32_t slot = thingsAllocSlot();
+  t->id = (uint64_t)THINGS.slots[slot].generation << 32 | slot;
+  thingsPlace(t, slot);
 }
 
 Result thingAdd(Thing* t) {
@@ -25,40 +133,194 @@ Result thingAdd(Thing* t) {
     return Err;
   }
 
-  int ret = 0;
-  khiter_t k;
-
-  do {
-    t->id = THINGS.curid++;
-  } while ((k = kh_get_thing(THINGS.things, t->id)) != kh_end(THINGS.things));
-
-  k = kh_put_thing(THINGS.things, t->id, &ret);
-  kh_value(THINGS.things, k) = t;
+  thingsInsert(t);
+  physicsAddThing(t);
 
-  log_debug("added thing with id %d", t->id);
+  log_debug("added thing %u (generation %u)", THING_INDEX(t->id),
+            THING_GENERATION(t->id));
 
   return Ok;
 }
 
-Result thingDelete(int id) {
+// thingAdd for many things at once, building their part of the broadphase in
+// one go.
+Result thingsAddBatch(Thing** things, int count) {
   if (!THINGS.init) {
     log_error("Thing manager not initialized!");
     return Err;
   }
+  if (count <= 0) return Ok;
 
-  khiter_t k;
-  k = kh_get_thing(THINGS.things, id);
+  while (THINGS.n + count > THINGS.cap) thingsGrow();
+  uint32_t first = THINGS.n;
+  ecsReserve(THINGS.n_slots + count, count);
+  for (int i = 0; i < count; i++) thingsInsert(things[i]);
 
-  if (k == kh_end(THINGS.things)) {
-    log_warn("Attempted to delete non-existent thing with id %d", id);
+  // the new things sit together at the end of dense
+  physicsAddThings(THINGS.dense + first, count);
+
+  log_debug("added %d things", count);
+  return Ok;
+}
+
+static void thingBury(Thing* t);
+
+Result thingDelete(ThingId id) {
+  if (!THINGS.init) {
+    log_error("Thing manager not initialized!");
     return Err;
   }
 
-  kh_del_thing(THINGS.things, k);
+  Thing* t = thingGet(id);
+  if (!t) {
+    log_warn("Attempted to delete non-existent thing %u (generation %u)",
+             THING_INDEX(id), THING_GENERATION(id));
+    return Err;
+  }
 
+  physicsRemoveThing(t);
+  bool kept = PHYSICS.tick >= THINGS.keep_since;
+  if (kept) thingBury(t);
+  ecsRemoveAll(THING_INDEX(id));
+  thingListRemove(&THINGS.types[t->type], THING_INDEX(id));
+
+  // fill the hole with the last thing to keep dense packed
+  uint32_t slot = THING_INDEX(id);
+  uint32_t hole = THINGS.slots[slot].dense;
+  uint32_t last = --THINGS.n;
+  THINGS.dense[hole] = THINGS.dense[last];
+  THINGS.dense_slot[hole] = THINGS.dense_slot[last];
+  THINGS.slots[THINGS.dense_slot[hole]].dense = hole;
+
+  // bump the generation so old handles go stale; 0 would make THING_NULL
+  // valid
+  ThingSlot* s = &THINGS.slots[slot];
+  if (++s->generation == 0) s->generation = 1;
+  s->dense = THINGS.free;
+  THINGS.free = slot;
+
+  if (!kept) poolFree(&THINGS.pool, t);
   return Ok;
 }
 
+/*
+ * =======
+ * @GRAVES
+ * =======
+ *
+ * A rollback can go back to before a thing was deleted, so while something
+ * might roll back, deleted things are kept as graves: the record, with its
+ * components as they were. thingRevive puts one back in its old slot with its
+ * old id. A SnapshotRing keeps the graves its oldest snapshot still needs.
+ */
+
+// Keep t, about to be deleted, as a grave.
+static void thingBury(Thing* t) {
+  Entity e = THING_INDEX(t->id);
+  Transform* tr = ecsGet(COMP_TRANSFORM, e);
+  Collider* c = ecsGet(COMP_COLLIDER, e);
+  Velocity* v = ecsGet(COMP_VELOCITY, e);
+  Material* m = ecsGet(COMP_MATERIAL, e);
+
+  Body* b = &t->body;
+  if (tr) {
+    glm_vec3_copy(tr->pos, b->pos);
+    glm_vec3_copy(tr->rot, b->rot);
+    glm_vec3_copy(tr->scale, b->scale);
+  }
+  if (c) {
+    glm_vec3_copy(c->halfsize, b->halfsize);
+    b->mass = c->mass;
+    b->is_dynamic = c->is_dynamic;
+    b->is_grounded = c->is_grounded;
+  }
+  if (v) glm_vec3_copy(v->linear, b->velocity);
+
+  ThingGrave g = {.thing = t, .tick = PHYSICS.tick, .has_color = m != NULL};
+  if (m) glm_vec4_copy(m->color, g.color);
+  kv_push(ThingGrave, THINGS.graves, g);
+}
+
+// Free the graves of things deleted before tick.
+static void thingsFreeGraves(int tick) {
+  size_t kept = 0;
+  for (size_t i = 0; i < THINGS.graves.n; i++) {
+    ThingGrave* g = &THINGS.graves.a[i];
+    if (g->tick < tick) {
+      poolFree(&THINGS.pool, g->thing);
+    } else {
+      THINGS.graves.a[kept++] = *g;
+    }
+  }
+  THINGS.graves.n = kept;
+}
+
+// Keep things deleted on tick since or later so thingRevive can bring them
+// back, and free those deleted before. THINGS_KEEP_NONE keeps none.
+void thingsKeepDeleted(int since) {
+  THINGS.keep_since = since;
+  thingsFreeGraves(since);
+}
+
+// Bring back a thing that was deleted and kept, with its id and the
+// components it had. Like thingsInsert it has no body until it's added to
+// physics. NULL if it wasn't kept, or its slot is in use.
+Thing* thingRevive(ThingId id) {
+  size_t i = 0;
+  while (i < THINGS.graves.n && THINGS.graves.a[i].thing->id != id) i++;
+  if (i == THINGS.graves.n) return NULL;
+  ThingGrave g = THINGS.graves.a[i];
+
+  // take the slot off the free list; revivals are rare, so a walk will do
+  uint32_t slot = THING_INDEX(id);
+  uint32_t* link = &THINGS.free;
+  while (*link != THING_NO_SLOT && *link != slot) {
+    link = &THINGS.slots[*link].dense;
+  }
+  if (*link == THING_NO_SLOT) {
+    log_error("can't revive thing %u (generation %u), its slot is in use",
+              slot, THING_GENERATION(id));
+    return NULL;
+  }
+  *link = THINGS.slots[slot].dense;
+  THINGS.slots[slot].generation = THING_GENERATION(id);
+
+  THINGS.graves.a[i] = THINGS.graves.a[--THINGS.graves.n];
+  thingsPlace(g.thing, slot);
+
+  Material* m = ecsGet(COMP_MATERIAL, slot);
+  if (g.has_color) {
+    if (!m) m = ecsAdd(COMP_MATERIAL, slot);
+    glm_vec4_copy(g.color, m->color);
+  } else if (m) {
+    ecsRemove(COMP_MATERIAL, slot);
+  }
+
+  log_debug("revived thing %u (generation %u)", slot, THING_GENERATION(id));
+  return g.thing;
+}
+
+// Memory that lives until the level is unloaded, e.g. the data things point
+// to with Thing.self.
+void* thingsLevelAlloc(size_t size) { return arenaAlloc(&THINGS.level, size); }
+
+// Delete every thing and free all level memory at once.
+void thingsUnloadLevel() {
+  while (THINGS.n) thingDelete(THINGS.dense[THINGS.n - 1]->id);
+  // what graves point to is level memory
+  thingsFreeGraves(THINGS_KEEP_NONE);
+  arenaReset(&THINGS.level);
+}
+
+void thingsLogStats() {
+  AllocStats* p = &THINGS.pool.stats;
+  AllocStats* l = &THINGS.level.stats;
+  log_info("things: %zu live, %zu peak, %zu reserved", p->live, p->peak,
+           p->capacity);
+  log_info("level memory: %zu bytes live, %zu peak, %zu reserved", l->live,
+           l->peak, l->capacity);
+}
+
 /*
  * ===========
  * @PRIMITIVES
@@ -223,13 +485,11 @@ unsigned int CUBE_INDICES[36] = {
 // clang-format on
 
 const char* triangleVert =
-    "#version 330 core\n"
+    "#version 330 core\n" CAMERA_GLSL
     "layout (location = 0) in vec3 pos;\n"
-    "uniform mat4 proj;\n"
-    "uniform mat4 view;\n"
     "uniform mat4 model;\n"
     "void main() {\n"
-    "gl_Position = proj * view * model * vec4(pos.xyz, 1.0f);\n"
+    "gl_Position = viewProj * model * vec4(pos.xyz, 1.0f);\n"
     "}";
 
 const char* triangleFrag =
@@ -313,12 +573,9 @@ RenderInfo renderInitCube() {
   return ri;
 }
 
-void renderCube(CubeThing* self, Body* body, RenderInfo ri, RenderMatrices rm,
-                RenderMods* mods) {
-  GL glUseProgram(ri.shader);
-  GL glBindVertexArray(ri.vao);
-
-  mat4 model;
+// Where a primitive's mesh goes for body: moved, turned about x then y, and
+// scaled.
+static void primitiveModel(Body* body, mat4 model) {
   glm_mat4_identity(model);
   glm_translate(model, body->pos);
 
@@ -326,12 +583,19 @@ void renderCube(CubeThing* self, Body* body, RenderInfo ri, RenderMatrices rm,
   glm_rotate(model, glm_rad(body->rot[1]), (vec3){0, 1, 0});
 
   glm_scale(model, body->scale);
+}
 
-  shaderSetMat4(ri.shader, "proj", *rm.proj);
-  shaderSetMat4(ri.shader, "view", *rm.view);
-  shaderSetMat4(ri.shader, "model", model);
+void renderCube(CubeThing* self, Body* body, RenderInfo ri, RenderMatrices rm,
+                RenderMods* mods) {
+  GL glUseProgram(ri.shader);
+  GL glBindVertexArray(ri.vao);
 
-  shaderSetVec4(ri.shader, "color", self->color);
+  mat4 model;
+  primitiveModel(body, model);
+
+  shaderSetMat4Id(ri.shader, UNIFORM_MODEL, model);
+
+  shaderSetVec4Id(ri.shader, UNIFORM_COLOR, self->color);
   GL glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 }
 
@@ -346,11 +610,9 @@ void renderAABB(CubeThing* self, Body* body, RenderInfo ri, RenderMatrices rm,
 
   glm_scale(model, body->scale);
 
-  shaderSetMat4(ri.shader, "proj", *rm.proj);
-  shaderSetMat4(ri.shader, "view", *rm.view);
-  shaderSetMat4(ri.shader, "model", model);
+  shaderSetMat4Id(ri.shader, UNIFORM_MODEL, model);
 
-  shaderSetVec4(ri.shader, "color", self->color);
+  shaderSetVec4Id(ri.shader, UNIFORM_COLOR, self->color);
   GL glDrawElements(GL_TRIANGLES, 36, GL_UNSIGNED_INT, 0);
 };
 
@@ -359,19 +621,11 @@ void renderTriangle(TriangleThing* self, Body* body, RenderInfo ri,
   GL glBindVertexArray(ri.vao);
   GL glUseProgram(ri.shader);
   mat4 model;
-  glm_mat4_identity(model);
-  glm_translate(model, body->pos);
+  primitiveModel(body, model);
 
-  glm_rotate(model, glm_rad(body->rot[0]), (vec3){1, 0, 0});
-  glm_rotate(model, glm_rad(body->rot[1]), (vec3){0, 1, 0});
+  shaderSetMat4Id(ri.shader, UNIFORM_MODEL, model);
 
-  glm_scale(model, body->scale);
-
-  shaderSetMat4(ri.shader, "proj", *rm.proj);
-  shaderSetMat4(ri.shader, "view", *rm.view);
-  shaderSetMat4(ri.shader, "model", model);
-
-  shaderSetVec4(ri.shader, "color", self->color);
+  shaderSetVec4Id(ri.shader, UNIFORM_COLOR, self->color);
 
   GL glDrawArrays(GL_TRIANGLES, 0, 3);
 }
@@ -382,30 +636,361 @@ void renderSquare(SquareThing* self, Body* body, RenderInfo ri,
   GL glBindVertexArray(ri.vao);
 
   mat4 model;
-  glm_mat4_identity(model);
-  glm_translate(model, body->pos);
+  primitiveModel(body, model);
 
-  glm_rotate(model, glm_rad(body->rot[0]), (vec3){1, 0, 0});
-  glm_rotate(model, glm_rad(body->rot[1]), (vec3){0, 1, 0});
+  shaderSetMat4Id(ri.shader, UNIFORM_MODEL, model);
 
-  glm_scale(model, body->scale);
+  shaderSetVec4Id(ri.shader, UNIFORM_COLOR, self->color);
+  GL glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+}
+
+/*
+ * ==========
+ * @INSTANCES
+ * ==========
+ *
+ * Every primitive of a type in one draw call: a frame's model matrices and
+ * colors go in one buffer the shader reads per instance, instead of a handful
+ * of uniform uploads and a draw call per thing.
+ */
 
-  shaderSetMat4(ri.shader, "proj", *rm.proj);
-  shaderSetMat4(ri.shader, "view", *rm.view);
-  shaderSetMat4(ri.shader, "model", model);
+_Static_assert(sizeof(Instance) == 20 * sizeof(float),
+               "instance attributes assume a tightly packed Instance");
 
-  shaderSetVec4(ri.shader, "color", self->color);
-  GL glDrawElements(GL_TRIANGLES, 6, GL_UNSIGNED_INT, 0);
+const char* instanceVert =
+    "#version 330 core\n" CAMERA_GLSL
+    "layout (location = 0) in vec3 pos;\n"
+    "layout (location = 1) in mat4 model;\n"
+    "layout (location = 5) in vec4 color;\n"
+    "out vec4 instanceColor;\n"
+    "void main() {\n"
+    "gl_Position = viewProj * model * vec4(pos.xyz, 1.0f);\n"
+    "instanceColor = color;\n"
+    "}";
+
+const char* instanceFrag =
+    "#version 330 core\n"
+    "in vec4 instanceColor;\n"
+    "out vec4 fragColor;\n"
+    "void main() {\n"
+    "fragColor = instanceColor;\n"
+    "}";
+
+// Set up batch to draw things of type. Only primitives can be drawn
+// instanced, anything else is Err.
+Result instancesInit(InstanceBatch* batch, int type) {
+  const float* vertices;
+  size_t vertices_size;
+  const unsigned int* indices = NULL;
+  size_t indices_size = 0;
+
+  *batch = (InstanceBatch){0};
+  switch (type) {
+    case THING_TRIANGLE:
+      vertices = TRIANGLE_VERTICES;
+      vertices_size = sizeof(TRIANGLE_VERTICES);
+      batch->count = 3;
+      break;
+    case THING_SQUARE:
+      vertices = SQUARE_VERTICES;
+      vertices_size = sizeof(SQUARE_VERTICES);
+      indices = SQUARE_INDICES;
+      indices_size = sizeof(SQUARE_INDICES);
+      batch->count = 6;
+      break;
+    case THING_CUBE:
+      vertices = CUBE_VERTICES;
+      vertices_size = sizeof(CUBE_VERTICES);
+      indices = CUBE_INDICES;
+      indices_size = sizeof(CUBE_INDICES);
+      batch->count = 36;
+      break;
+    default:
+      return Err;
+  }
+
+  unsigned int vbo, ebo;
+  GL glGenVertexArrays(1, &batch->vao);
+  GL glGenBuffers(1, &vbo);
+  GL glGenBuffers(1, &batch->instance_vbo);
+
+  GL glBindVertexArray(batch->vao);
+  GL glBindBuffer(GL_ARRAY_BUFFER, vbo);
+  GL glBufferData(GL_ARRAY_BUFFER, vertices_size, vertices, GL_STATIC_DRAW);
+  GL glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float),
+                           (void*)0);
+  GL glEnableVertexAttribArray(0);
+
+  if (indices) {
+    GL glGenBuffers(1, &ebo);
+    GL glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    GL glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices_size, indices,
+                    GL_STATIC_DRAW);
+    batch->indexed = true;
+  }
+
+  // the model matrix takes an attribute per column, then the color
+  GL glBindBuffer(GL_ARRAY_BUFFER, batch->instance_vbo);
+  for (int i = 0; i < 5; i++) {
+    GL glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                             (void*)(i * sizeof(vec4)));
+    GL glVertexAttribDivisor(1 + i, 1);
+    GL glEnableVertexAttribArray(1 + i);
+  }
+
+  batch->shader = shaderFromCharVF(instanceVert, instanceFrag);
+  checkGlError();
+  return Ok;
 }
 
-Thing* thingLoadFromData(void* data, int type, Body* body) {
-  Renderable render;
-  Thing* dest = malloc(sizeof(Thing));
+// Fill in dest to draw a primitive where body is.
+void instanceFromBody(Instance* dest, Body* body, vec4 color) {
+  primitiveModel(body, dest->model);
+  glm_vec4_copy(color, dest->color);
+}
 
-  if (!dest) {
-    log_error("failed to allocate memory for thing with type: %d", type);
-    return NULL;
+// Fill in dest to draw a box around body, which doesn't turn with it.
+void instanceFromAABB(Instance* dest, Body* body, vec4 color) {
+  glm_mat4_identity(dest->model);
+  glm_translate(dest->model, body->pos);
+  glm_scale(dest->model, body->scale);
+  glm_vec4_copy(color, dest->color);
+}
+
+// Draw n instances. The batch's program and VAO must be bound.
+void instancesDraw(InstanceBatch* batch, Instance* instances, uint32_t n) {
+  // a new store every time, so the driver needn't wait on the last draw's
+  GL glBindBuffer(GL_ARRAY_BUFFER, batch->instance_vbo);
+  GL glBufferData(GL_ARRAY_BUFFER, sizeof(Instance) * n, instances,
+                  GL_STREAM_DRAW);
+
+  if (batch->indexed) {
+    GL glDrawElementsInstanced(GL_TRIANGLES, batch->count, GL_UNSIGNED_INT, 0,
+                               n);
+  } else {
+    GL glDrawArraysInstanced(GL_TRIANGLES, 0, batch->count, n);
   }
+}
+
+/*
+ * =============
+ * @RENDER QUEUE
+ * =============
+ *
+ * Draws are queued with a 64 bit key and drawn in key order. The pass is the
+ * top bits, so everything opaque draws before anything transparent. Opaque
+ * keys go on with the shader, then the VAO, then the depth, which groups
+ * draws sharing state and draws front to back within a group so the depth
+ * test throws away what's hidden. Transparent keys go on with the depth,
+ * inverted, so they draw back to front and blend right, whatever state that
+ * costs.
+ *
+ * Consecutive draws of a batch after sorting become one instanced draw, and
+ * programs and VAOs are only bound when they change.
+ */
+
+#define KEY_PASS_SHIFT 62
+#define KEY_STATE_BITS 32  // 16 each for the shader and the VAO
+#define KEY_DEPTH_BITS 24
+#define KEY_DEPTH_MASK ((1ull << KEY_DEPTH_BITS) - 1)
+
+void renderQueueInit(RenderQueue* q, uint32_t capacity) {
+  *q = (RenderQueue){0};
+  q->items = malloc(sizeof(RenderItem) * capacity);
+  q->sorted = malloc(sizeof(RenderItem) * capacity);
+  q->instances = malloc(sizeof(Instance) * capacity);
+  q->staging = malloc(sizeof(Instance) * capacity);
+  if (!q->items || !q->sorted || !q->instances || !q->staging) {
+    log_error("failed to allocate a render queue of %u", capacity);
+    exit(1);
+  }
+  q->cap = capacity;
+}
+
+// depth is anything that grows with distance from the camera, e.g. distance
+// squared. Negative depths count as 0.
+uint64_t renderKey(int pass, unsigned int shader, unsigned int vao,
+                   float depth) {
+  // non-negative floats order the same as their bits. The sign bit is 0, and
+  // the lowest mantissa bits only split hairs, so 24 bits are plenty and make
+  // one less byte to sort on.
+  uint32_t bits;
+  depth = MAX(depth, 0);
+  memcpy(&bits, &depth, sizeof(bits));
+  uint64_t d = bits >> (31 - KEY_DEPTH_BITS);
+  uint64_t state = (uint64_t)(shader & 0xffff) << 16 | (vao & 0xffff);
+
+  uint64_t key = (uint64_t)pass << KEY_PASS_SHIFT;
+  if (pass == PASS_TRANSPARENT) {
+    return key | (~d & KEY_DEPTH_MASK) << KEY_STATE_BITS | state;
+  }
+  return key | state << KEY_DEPTH_BITS | d;
+}
+
+static RenderItem* renderQueueAdd(RenderQueue* q) {
+  if (q->n == q->cap) {
+    uint32_t cap = MAX(q->cap * 2, 256);
+    q->items = realloc(q->items, sizeof(RenderItem) * cap);
+    q->sorted = realloc(q->sorted, sizeof(RenderItem) * cap);
+    q->instances = realloc(q->instances, sizeof(Instance) * cap);
+    q->staging = realloc(q->staging, sizeof(Instance) * cap);
+    if (!q->items || !q->sorted || !q->instances || !q->staging) {
+      log_error("failed to grow the render queue to %u", cap);
+      exit(1);
+    }
+    q->cap = cap;
+  }
+  return &q->items[q->n++];
+}
+
+// Queue an instance of batch. Fill in the returned instance.
+Instance* renderQueueInstance(RenderQueue* q, uint64_t key, int batch) {
+  RenderItem* item = renderQueueAdd(q);
+  *item = (RenderItem){.key = key, .index = q->n - 1, .batch = batch};
+  return &q->instances[item->index];
+}
+
+// Queue a call to a render func. Fill in the returned call.
+RenderCall* renderQueueCall(RenderQueue* q, uint64_t key) {
+  if (q->n_calls == q->calls_cap) {
+    uint32_t cap = MAX(q->calls_cap * 2, 16);
+    q->calls = realloc(q->calls, sizeof(RenderCall) * cap);
+    if (!q->calls) {
+      log_error("failed to grow the render queue to %u calls", cap);
+      exit(1);
+    }
+    q->calls_cap = cap;
+  }
+
+  RenderItem* item = renderQueueAdd(q);
+  *item = (RenderItem){.key = key, .index = q->n_calls, .batch = -1};
+  return &q->calls[q->n_calls++];
+}
+
+// Least significant byte first radix sort of n items from src, using dst as
+// scratch. Returns whichever of the two ends up sorted. Stable, so draws with
+// equal keys stay in the order they were queued.
+static RenderItem* radixSort(RenderItem* src, RenderItem* dst, uint32_t n) {
+  static uint32_t counts[8][256];
+  memset(counts, 0, sizeof(counts));
+  for (uint32_t i = 0; i < n; i++) {
+    uint64_t key = src[i].key;
+    for (int b = 0; b < 8; b++) counts[b][(key >> (b * 8)) & 0xff]++;
+  }
+
+  for (int b = 0; b < 8; b++) {
+    uint32_t* count = counts[b];
+
+    // every key has the same byte here, e.g. most of the state bits
+    if (count[(src[0].key >> (b * 8)) & 0xff] == n) continue;
+
+    for (uint32_t i = 0, sum = 0; i < 256; i++) {
+      uint32_t c = count[i];
+      count[i] = sum;
+      sum += c;
+    }
+    for (uint32_t i = 0; i < n; i++) {
+      dst[count[(src[i].key >> (b * 8)) & 0xff]++] = src[i];
+    }
+
+    RenderItem* tmp = src;
+    src = dst;
+    dst = tmp;
+  }
+  return src;
+}
+
+// Split the items by pass, then sort each pass on its own. Depth is at the
+// bottom of opaque keys and the top of transparent ones, so sorting both at
+// once would make every byte of the key vary.
+static void renderQueueSort(RenderQueue* q) {
+  uint32_t starts[4] = {0};
+  for (uint32_t i = 0; i < q->n; i++) {
+    starts[q->items[i].key >> KEY_PASS_SHIFT]++;
+  }
+  uint32_t ends[4];
+  for (int p = 0, sum = 0; p < 4; p++) {
+    ends[p] = sum += starts[p];
+    starts[p] = ends[p] - starts[p];
+  }
+
+  uint32_t next[4];
+  memcpy(next, starts, sizeof(next));
+  for (uint32_t i = 0; i < q->n; i++) {
+    q->sorted[next[q->items[i].key >> KEY_PASS_SHIFT]++] = q->items[i];
+  }
+
+  for (int p = 0; p < 4; p++) {
+    uint32_t n = ends[p] - starts[p];
+    if (!n) continue;
+
+    RenderItem* sorted =
+        radixSort(q->sorted + starts[p], q->items + starts[p], n);
+    if (sorted != q->items + starts[p]) {
+      memcpy(q->items + starts[p], sorted, sizeof(RenderItem) * n);
+    }
+  }
+}
+
+// Draw everything queued, in key order, and empty the queue.
+void renderQueueSubmit(RenderQueue* q, InstanceBatch* batches,
+                       RenderMatrices rm) {
+  if (!q->n) return;
+  renderQueueSort(q);
+
+  unsigned int shader = 0, vao = 0;  // bound now, or 0 if unknown
+  bool depth_writes = true;
+
+  for (uint32_t i = 0; i < q->n;) {
+    RenderItem* item = &q->items[i];
+
+    // transparent things mustn't hide each other, they're blended in order
+    if (item->key >> KEY_PASS_SHIFT == PASS_TRANSPARENT && depth_writes) {
+      GL glDepthMask(GL_FALSE);
+      depth_writes = false;
+    }
+
+    if (item->batch < 0) {
+      RenderCall* c = &q->calls[item->index];
+      c->rfunc(c->self, &c->body, c->ri, rm, NULL);
+      shader = vao = 0;  // it binds its own
+      i++;
+      continue;
+    }
+
+    // the run of draws of this batch in this pass, as one instanced draw
+    uint64_t pass = item->key >> KEY_PASS_SHIFT;
+    uint32_t end = i;
+    for (; end < q->n && q->items[end].batch == item->batch &&
+           q->items[end].key >> KEY_PASS_SHIFT == pass;
+         end++) {
+      q->staging[end - i] = q->instances[q->items[end].index];
+    }
+
+    InstanceBatch* batch = &batches[item->batch];
+    if (shader != batch->shader) {
+      GL glUseProgram(batch->shader);
+      shader = batch->shader;
+    }
+    if (vao != batch->vao) {
+      GL glBindVertexArray(batch->vao);
+      vao = batch->vao;
+    }
+    instancesDraw(batch, q->staging, end - i);
+    i = end;
+  }
+
+  if (!depth_writes) {
+    GL glDepthMask(GL_TRUE);
+  }
+  q->n = 0;
+  q->n_calls = 0;
+}
+
+// Fill in dest as a thing of the given type. Computes the body's halfsize
+// for types with a known shape.
+static Result thingSetup(Thing* dest, void* data, int type, Body* body) {
+  Renderable render;
 
   switch (type) {
     case THING_PLAYER:
@@ -434,13 +1019,115 @@ Thing* thingLoadFromData(void* data, int type, Body* body) {
       break;
     default:
       log_error("Unknown type id: %d", type);
-      return NULL;
+      return Err;
   }
 
   dest->type = type;
   dest->self = data;
   dest->body = *body;
   dest->render = render;
+  dest->id = THING_NULL;
+  dest->proxy = BVH_NULL;
+  dest->body_idx = -1;
+
+  return Ok;
+}
+
+Thing* thingLoadFromData(void* data, int type, Body* body) {
+  Thing* dest = poolAlloc(&THINGS.pool);
+
+  if (!dest) {
+    log_error("failed to allocate memory for thing with type: %d", type);
+    return NULL;
+  }
+
+  if (is_err(thingSetup(dest, data, type, body))) {
+    poolFree(&THINGS.pool, dest);
+    return NULL;
+  }
+
+  return dest;
+}
+
+// A new thing like an existing one, but with its own body. Ready for
+// thingAdd.
+Thing* thingClone(const Thing* like, Body* body) {
+  Thing* dest = poolAlloc(&THINGS.pool);
+
+  if (!dest) {
+    log_error("failed to allocate memory for thing with type: %d", like->type);
+    return NULL;
+  }
+
+  *dest = *like;
+  dest->body = *body;
+  dest->id = THING_NULL;
+  dest->proxy = BVH_NULL;
+  dest->body_idx = -1;
 
   return dest;
 }
+
+/*
+ * ========
+ * @PREFABS
+ * ========
+ */
+
+// Set up a prefab from the same data thingLoadFromData takes. body is the
+// default every spawn starts from.
+Result prefabInit(Prefab* p, void* data, int type, Body* body) {
+  Body b = *body;
+  if (is_err(thingSetup(&p->like, data, type, &b))) return Err;
+
+  // keep the halfsize at scale 1, so spawns can be scaled freely
+  for (int i = 0; i < 3; i++) {
+    float scale = b.scale[i] ? b.scale[i] : 1;
+    p->halfsize[i] = p->like.body.halfsize[i] / scale;
+  }
+
+  return Ok;
+}
+
+// Spawn count copies of a prefab, one per transform, in a single pass. Their
+// ids are written to out if it isn't NULL. The prefab's thing should have
+// been through rendererAddThing already if it is drawn. If memory runs out,
+// the things spawned until then stay and it returns Err.
+Result thingSpawnBatch(Prefab* p, int count, Transform* transforms,
+                       ThingId* out) {
+  if (!THINGS.init) {
+    log_error("Thing manager not initialized!");
+    return Err;
+  }
+  if (count <= 0) return Ok;
+
+  while (THINGS.n + count > THINGS.cap) thingsGrow();
+  uint32_t first = THINGS.n;
+  ecsReserve(THINGS.n_slots + count, count);
+
+  int spawned = 0;
+  for (; spawned < count; spawned++) {
+    Thing* t = poolAlloc(&THINGS.pool);
+    if (!t) {
+      log_error("failed to allocate memory for thing %d of %d with type: %d",
+                spawned, count, p->like.type);
+      break;
+    }
+    *t = p->like;
+
+    Body* b = &t->body;
+    glm_vec3_copy(transforms[spawned].pos, b->pos);
+    glm_vec3_copy(transforms[spawned].rot, b->rot);
+    glm_vec3_copy(transforms[spawned].scale, b->scale);
+    glm_vec3_mul(p->halfsize, b->scale, b->halfsize);
+
+    thingsInsert(t);
+    if (out) out[spawned] = t->id;
+  }
+
+  // the new things sit together at the end of dense
+  if (spawned) physicsAddThings(THINGS.dense + first, spawned);
+
+  log_debug("spawned %d things of type %d", spawned, p->like.type);
+  return spawned == count ? Ok : Err;
+}
@@ -1,7 +1,9 @@
 #ifndef THING
 #define THING
 #include <cglm/cglm.h>
-#include "khash.h"
+#include <limits.h>
+#include <stdint.h>
+#include "alloc.h"
 #include "log.h"
 
 // openGL handles to render an object
@@ -29,6 +31,7 @@ enum {
   THING_CUBE,
   THING_SQUARE,
   THING_BACKPACK,
+  THING_TYPE_COUNT,
 };
 
 typedef struct TriangleThing {
@@ -47,9 +50,23 @@ typedef struct CubeThing {
 typedef struct {
 } RenderMods;
 
+// One primitive in an instanced draw.
+typedef struct Instance {
+  mat4 model;
+  vec4 color;
+} Instance;
+
+// A primitive type's instanced draw.
+typedef struct InstanceBatch {
+  unsigned int vao, shader, instance_vbo;
+  int count;     // vertices, or indices if indexed, per instance; 0 if unset
+  bool indexed;  // drawn with an element buffer
+} InstanceBatch;
+
 // physical information about the object being rendered
 typedef struct {
   vec3 pos;
+  vec3 prev_pos;  // pos as of the previous physics tick
   vec3 rot;
   vec3 scale;
   vec3 halfsize;
@@ -77,35 +94,156 @@ typedef struct {
   };
 } Renderable;
 
-// A thing
+// Render passes, in the order they draw.
+enum {
+  PASS_OPAQUE,
+  PASS_TRANSPARENT,
+};
+
+// A draw in a RenderQueue. Draws of a batch are instances; anything else is
+// a call to its render func.
+typedef struct RenderItem {
+  uint64_t key;    // see renderKey
+  uint32_t index;  // into the queue's instances, or its calls if batch < 0
+  int32_t batch;
+} RenderItem;
+
+typedef struct RenderCall {
+  RenderFunc rfunc;
+  void* self;
+  Body body;
+  RenderInfo ri;
+} RenderCall;
+
+// A frame's draws, sorted by key before they're submitted. The arrays are
+// kept between frames, so after the first few nothing is allocated.
+typedef struct RenderQueue {
+  RenderItem* items;
+  RenderItem* sorted;   // scratch for sorting
+  Instance* instances;  // per item, for items in a batch
+  Instance* staging;    // one run of instances, as uploaded
+  RenderCall* calls;
+  uint32_t n, cap;
+  uint32_t n_calls, calls_cap;
+} RenderQueue;
+
+// Handle to a thing. The low 32 bits are its slot in the thing manager, the
+// high 32 bits the generation of that slot, so a handle to a deleted thing
+// never finds whatever reuses its slot.
+typedef uint64_t ThingId;
+
+#define THING_NULL 0  // generations start at 1, so no live thing has this id
+#define THING_INDEX(id) ((uint32_t)(id))
+#define THING_GENERATION(id) ((uint32_t)((id) >> 32))
+
+// A thing. body and render are what it was loaded with; thingAdd copies them
+// into its components (see ecs.h), which are the live state from then on.
 typedef struct {
   Body body;
   int type;
   Renderable render;
   void* self;
-  uint16_t id;
+  ThingId id;
+  int proxy;     // leaf in the physics broadphase
+  int body_idx;  // slot in the physics body store
 } Thing;
 
-// map thing IDs to thing pointers
-KHASH_MAP_INIT_INT(thing, Thing*);
-
+typedef struct ThingSlot {
+  uint32_t dense;  // index in Things.dense, or the next free slot if unused
+  uint32_t generation;
+} ThingSlot;
+
+// Secondary index: a packed list of thing slots, with O(1) add and remove.
+typedef struct ThingList {
+  uint32_t* slots;
+  uint32_t n, cap;
+  uint32_t* where;  // slot -> index in slots, THING_NO_SLOT if absent
+  uint32_t n_where;
+} ThingList;
+
+// A deleted thing kept so a rollback can bring it back, see thingsKeepDeleted.
+typedef struct ThingGrave {
+  Thing* thing;  // its record, with body set to its components when deleted
+  int tick;      // PHYSICS.tick it was deleted on
+  bool has_color;
+  vec4 color;  // its Material's
+} ThingGrave;
+
+// Slot map from thing ids to things. Live things are packed at the front of
+// dense, so iterating is a plain loop over dense[0, n).
 typedef struct things {
-  kh_thing_t* things;  // map of ID to thing
-  int curid;           // state used to generate thing IDs.
+  Thing** dense;
+  uint32_t* dense_slot;  // slot of each dense entry
+  uint32_t n, cap;
+
+  ThingSlot* slots;
+  uint32_t n_slots, slot_cap;
+  uint32_t free;  // first unused slot, THING_NO_SLOT if none
+
+  // Things of each type. Things that are drawn don't need a list, the
+  // Renderable component set is one, and physics keeps its own dynamic mask.
+  ThingList types[THING_TYPE_COUNT];
+
+  kvec_t(ThingGrave) graves;
+  int keep_since;  // things deleted on this tick or later are kept
+
+  Pool pool;    // Thing records
+  Arena level;  // per-level data, freed by thingsUnloadLevel
   bool init;
 } Things;
 
+#define THING_NO_SLOT UINT32_MAX
+#define THINGS_KEEP_NONE INT_MAX  // keep_since for keeping no deleted things
+
+// Template for spawning many things of one type with thingSpawnBatch.
+typedef struct Prefab {
+  Thing like;     // type, data, default body and render info
+  vec3 halfsize;  // like's halfsize at scale 1
+} Prefab;
+
+// things reserved per pool chunk, and bytes per level arena chunk
+#define THINGS_POOL_CHUNK 256
+#define THINGS_LEVEL_CHUNK (64 * 1024)
+
 extern Things THINGS;
 
 void thingsInit();
 Result thingAdd(Thing* t);
+Result thingsAddBatch(Thing** things, int count);
+Result thingDelete(ThingId id);
+Thing* thingGet(ThingId id);
+Thing* thingAt(uint32_t slot);
+void thingsKeepDeleted(int since);
+Thing* thingRevive(ThingId id);
+void* thingsLevelAlloc(size_t size);
+void thingsUnloadLevel();
+void thingsLogStats();
 
 Thing* thingLoadFromData(void* data, int type, Body* loc);
+Thing* thingClone(const Thing* like, Body* body);
+
+struct Transform;
+Result prefabInit(Prefab* p, void* data, int type, Body* body);
+Result thingSpawnBatch(Prefab* p, int count, struct Transform* transforms,
+                       ThingId* out);
 void renderCube(CubeThing* self, Body* body, RenderInfo ri, RenderMatrices rm,
                 RenderMods* mods);
 void renderAABB(CubeThing* self, Body* body, RenderInfo ri, RenderMatrices rm,
                 RenderMods* mods);
 
+Result instancesInit(InstanceBatch* batch, int type);
+void instanceFromBody(Instance* dest, Body* body, vec4 color);
+void instanceFromAABB(Instance* dest, Body* body, vec4 color);
+void instancesDraw(InstanceBatch* batch, Instance* instances, uint32_t n);
+
+void renderQueueInit(RenderQueue* q, uint32_t capacity);
+uint64_t renderKey(int pass, unsigned int shader, unsigned int vao,
+                   float depth);
+Instance* renderQueueInstance(RenderQueue* q, uint64_t key, int batch);
+RenderCall* renderQueueCall(RenderQueue* q, uint64_t key);
+void renderQueueSubmit(RenderQueue* q, InstanceBatch* batches,
+                       RenderMatrices rm);
+
 Hit aabbIntersectRay(vec3 pos, vec3 magnitude, Body* body);
 void aabbMinkowskiDifference(Body* a, Body* b, Body* dest);
 #endif
@@ -1,7 +1,9 @@
 #include "glad.h"
 #include "utils.h"
 #include "log.h"
+#include "khash.h"
 
+#include <stdlib.h>
 #include <string.h>
 /*
  * ========
@@ -11,6 +13,10 @@
 
 static int success;
 static char shaderLog[512];
+static unsigned int cameraBuffer;
+
+_Static_assert(sizeof(CameraBlock) == 4 * 64 + 16,
+               "CameraBlock doesn't match the std140 Camera block");
 
 enum {
   LEFT,
@@ -50,6 +56,16 @@ const char* rSplitOnce(const char* input, const char* delim, int side) {
   return NULL;
 }
 
+static void shaderResolveUniforms(unsigned int shader);
+
+// Point a freshly linked shader's uniform blocks at their binding points.
+static void shaderBindBlocks(unsigned int shader) {
+  unsigned int camera = glGetUniformBlockIndex(shader, "Camera");
+  if (camera != GL_INVALID_INDEX) {
+    glUniformBlockBinding(shader, camera, CAMERA_BINDING);
+  }
+}
+
 unsigned int shaderFromFileVF(const char* vertfile, const char* fragfile) {
   unsigned int frag, vert;
   const char* src_string;
@@ -91,6 +107,8 @@ unsigned int shaderFromFileVF(const char* vertfile, const char* fragfile) {
     glGetProgramInfoLog(shader, 512, NULL, shaderLog);
     log_error("SHADER LINKING FAILED:\n%s\n", shaderLog);
   }
+  shaderBindBlocks(shader);
+  shaderResolveUniforms(shader);
 
   glDeleteShader(vert);
   glDeleteShader(frag);
@@ -132,6 +150,8 @@ unsigned int shaderFromCharVF(const char* vertcode, const char* fragcode) {
     glGetProgramInfoLog(shader, 512, NULL, shaderLog);
     log_error("SHADER LINKING FAILED:\n%s\n", shaderLog);
   }
+  shaderBindBlocks(shader);
+  shaderResolveUniforms(shader);
 
   glDeleteShader(vert);
   glDeleteShader(frag);
@@ -139,56 +159,212 @@ unsigned int shaderFromCharVF(const char* vertcode, const char* fragcode) {
   return shader;
 }
 
+// Make the camera's uniform buffer and bind it at CAMERA_BINDING.
+void cameraBlockInit() {
+  glGenBuffers(1, &cameraBuffer);
+  glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+  glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraBlock), NULL, GL_DYNAMIC_DRAW);
+  glBindBufferBase(GL_UNIFORM_BUFFER, CAMERA_BINDING, cameraBuffer);
+}
+
+// Give every shader the camera as it is this frame.
+void cameraBlockUpload(CameraBlock* block) {
+  glBindBuffer(GL_UNIFORM_BUFFER, cameraBuffer);
+  glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CameraBlock), block);
+}
+
+/*
+ * =========
+ * @UNIFORMS
+ * =========
+ *
+ * Every uniform name gets a handle, the same in every shader. When a shader
+ * is linked, the location of each of its active uniforms goes in a table by
+ * handle, so setting a uniform is an array lookup rather than a call into
+ * the driver with a string. Setting by name hashes the name to its handle.
+ */
+
+KHASH_MAP_INIT_STR(uniform, int);
+
+// A linked shader's uniform locations by handle.
+typedef struct ShaderUniforms {
+  GLint* locations;
+  int n;  // handles that existed when it was linked; later ones it hasn't got
+} ShaderUniforms;
+
+static struct {
+  kh_uniform_t* handles;     // name -> handle
+  int n;                     // handles made so far
+  ShaderUniforms* programs;  // by program name
+  unsigned int n_programs;
+} UNIFORMS;
+
+static const char* BUILTIN_UNIFORMS[UNIFORM_BUILTIN_COUNT] = {
+    [UNIFORM_MODEL] = "model",
+    [UNIFORM_COLOR] = "color",
+    [UNIFORM_TEXT_COLOR] = "textColor",
+    [UNIFORM_TRANSFORMS] = "transforms",
+    [UNIFORM_LETTER_MAP] = "letterMap",
+};
+
+// The handle of a name, or -1 if none has been made.
+static int uniformFind(const char* name) {
+  if (!UNIFORMS.handles) {
+    UNIFORMS.handles = kh_init_uniform();
+    for (int i = 0; i < UNIFORM_BUILTIN_COUNT; i++) {
+      shaderUniform(BUILTIN_UNIFORMS[i]);
+    }
+  }
+
+  khiter_t k = kh_get_uniform(UNIFORMS.handles, name);
+  return k == kh_end(UNIFORMS.handles) ? -1 : kh_val(UNIFORMS.handles, k);
+}
+
+// The handle of a uniform name, made on first use.
+int shaderUniform(const char* name) {
+  int handle = uniformFind(name);
+  if (handle >= 0) return handle;
+
+  int ret;
+  char* key = strdup(name);
+  if (!key) {
+    log_error("failed to allocate uniform name %s", name);
+    exit(1);
+  }
+  khiter_t k = kh_put_uniform(UNIFORMS.handles, key, &ret);
+  kh_val(UNIFORMS.handles, k) = UNIFORMS.n;
+  return UNIFORMS.n++;
+}
+
+// Find the location of every active uniform of a freshly linked shader.
+static void shaderResolveUniforms(unsigned int shader) {
+  GLint n = 0;
+  glGetProgramiv(shader, GL_ACTIVE_UNIFORMS, &n);
+
+  // arrays are listed as name[0], and also go by name
+  int* handles = malloc(sizeof(int) * 2 * (n + 1));
+  GLint* locations = malloc(sizeof(GLint) * 2 * (n + 1));
+  if (!handles || !locations) {
+    log_error("failed to allocate %d uniforms", n);
+    exit(1);
+  }
+
+  int found = 0;
+  for (GLint i = 0; i < n; i++) {
+    char name[256] = {0};
+    GLsizei len = 0;
+    GLint size;
+    GLenum type;
+    glGetActiveUniform(shader, i, sizeof(name), &len, &size, &type, name);
+
+    // block members have no location of their own
+    GLint location = len > 0 ? glGetUniformLocation(shader, name) : -1;
+    if (location < 0) continue;
+
+    handles[found] = shaderUniform(name);
+    locations[found++] = location;
+    if (len > 3 && !strcmp(name + len - 3, "[0]")) {
+      name[len - 3] = '\0';
+      handles[found] = shaderUniform(name);
+      locations[found++] = location;
+    }
+  }
+
+  if (shader >= UNIFORMS.n_programs) {
+    unsigned int grown = MAX(shader + 1, UNIFORMS.n_programs * 2);
+    UNIFORMS.programs =
+        realloc(UNIFORMS.programs, sizeof(ShaderUniforms) * grown);
+    if (!UNIFORMS.programs) {
+      log_error("failed to allocate uniforms for %u shaders", grown);
+      exit(1);
+    }
+    memset(UNIFORMS.programs + UNIFORMS.n_programs, 0,
+           sizeof(ShaderUniforms) * (grown - UNIFORMS.n_programs));
+    UNIFORMS.n_programs = grown;
+  }
+
+  ShaderUniforms* u = &UNIFORMS.programs[shader];
+  u->locations = realloc(u->locations, sizeof(GLint) * (UNIFORMS.n + 1));
+  if (!u->locations) {
+    log_error("failed to allocate %d uniform locations", UNIFORMS.n);
+    exit(1);
+  }
+  u->n = UNIFORMS.n;
+  for (int i = 0; i < u->n; i++) u->locations[i] = -1;
+  for (int i = 0; i < found; i++) u->locations[handles[i]] = locations[i];
+
+  free(handles);
+  free(locations);
+}
+
+// Where the uniform with a handle is in shader, or -1 if it hasn't got it,
+// which glUniform* ignores.
+int shaderLocation(unsigned int shader, int uniform) {
+  if (shader >= UNIFORMS.n_programs || uniform < 0) return -1;
+
+  ShaderUniforms* u = &UNIFORMS.programs[shader];
+  return uniform < u->n ? u->locations[uniform] : -1;
+}
+
+// Where a uniform is in shader by name. Shaders not made by shaderFrom*VF
+// have no table, so those ask the driver.
+static GLint shaderLocationByName(unsigned int shader, const char* uni) {
+  if (shader >= UNIFORMS.n_programs || !UNIFORMS.programs[shader].locations) {
+    return glGetUniformLocation(shader, uni);
+  }
+  return shaderLocation(shader, uniformFind(uni));
+}
+
 void shaderSetVec4(unsigned int shader, const char* uni, vec4 dat) {
-  GLint loc = glGetUniformLocation(shader, uni);
-  /* glUseProgram(shader); */
-  glUniform4fv(loc, 1, dat);
+  glUniform4fv(shaderLocationByName(shader, uni), 1, dat);
 }
 
 void shaderSetMat4(unsigned int shader, const char* uni, mat4 dat) {
-  GLint loc = glGetUniformLocation(shader, uni);
-  /* if (loc == -1) { */
-  /*   printf("Failed to find uniform %s\n", uni); */
-  /* } */
-  /* glUseProgram(shader); */
-  glUniformMatrix4fv(loc, 1, GL_FALSE, (float*)dat);
+  glUniformMatrix4fv(shaderLocationByName(shader, uni), 1, GL_FALSE,
+                     (float*)dat);
 }
 
 void shaderSetVec3(unsigned int shader, const char* uni, vec3 dat) {
-  GLint loc = glGetUniformLocation(shader, uni);
-  /* if (loc == -1) { */
-  /*   printf("Failed to find uniform %s\n", uni); */
-  /* } */
-  /* glUseProgram(shader); */
-  glUniform3fv(loc, 1, dat);
+  glUniform3fv(shaderLocationByName(shader, uni), 1, dat);
 }
 
 void shaderSetFloat(unsigned int shader, const char* uni, float dat) {
-  GLint loc = glGetUniformLocation(shader, uni);
-  /* if (loc == -1) { */
-  /*   printf("Failed to find uniform %s\n", uni); */
-  /* } */
-  /* glUseProgram(shader); */
-  glUniform1f(loc, dat);
+  glUniform1f(shaderLocationByName(shader, uni), dat);
 }
 
 void shaderSetUnsignedInt(unsigned int shader, const char* uni,
                           unsigned int dat) {
-  GLint loc = glGetUniformLocation(shader, uni);
-  /* if (loc == -1) { */
-  /*   printf("Failed to find uniform %s\n", uni); */
-  /* } */
-  /* glUseProgram(shader); */
-  glUniform1ui(loc, dat);
+  glUniform1ui(shaderLocationByName(shader, uni), dat);
 }
 
 void shaderSetInt(unsigned int shader, const char* uni, int dat) {
-  GLint loc = glGetUniformLocation(shader, uni);
-  /* if (loc == -1) { */
-  /*   printf("Failed to find uniform %s\n", uni); */
-  /* } */
-  /* glUseProgram(shader); */
-  glUniform1i(loc, dat);
+  glUniform1i(shaderLocationByName(shader, uni), dat);
+}
+
+void shaderSetVec4Id(unsigned int shader, int uniform, vec4 dat) {
+  glUniform4fv(shaderLocation(shader, uniform), 1, dat);
+}
+
+void shaderSetMat4Id(unsigned int shader, int uniform, mat4 dat) {
+  glUniformMatrix4fv(shaderLocation(shader, uniform), 1, GL_FALSE,
+                     (float*)dat);
+}
+
+void shaderSetVec3Id(unsigned int shader, int uniform, vec3 dat) {
+  glUniform3fv(shaderLocation(shader, uniform), 1, dat);
+}
+
+void shaderSetFloatId(unsigned int shader, int uniform, float dat) {
+  glUniform1f(shaderLocation(shader, uniform), dat);
+}
+
+void shaderSetUnsignedIntId(unsigned int shader, int uniform,
+                            unsigned int dat) {
+  glUniform1ui(shaderLocation(shader, uniform), dat);
+}
+
+void shaderSetIntId(unsigned int shader, int uniform, int dat) {
+  glUniform1i(shaderLocation(shader, uniform), dat);
 }
 
 /*
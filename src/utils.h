@@ -8,8 +8,8 @@
  * =======
  */
 
-#define MIN(a, b) (a) > (b) ? (b) : (a)
-#define MAX(a, b) (a) > (b) ? (a) : (b)
+#define MIN(a, b) ((a) > (b) ? (b) : (a))
+#define MAX(a, b) ((a) > (b) ? (a) : (b))
 
 const char* rSplitOnce(const char* input, const char* delim, int side);
 
@@ -26,6 +26,55 @@ void shaderSetUnsignedInt(unsigned int shader, const char* uni,
 
 void shaderSetInt(unsigned int shader, const char* uni, int dat);
 
+// Handles of the uniforms the built-in shaders use. Any other name gets one
+// from shaderUniform.
+enum {
+  UNIFORM_MODEL,
+  UNIFORM_COLOR,
+  UNIFORM_TEXT_COLOR,
+  UNIFORM_TRANSFORMS,
+  UNIFORM_LETTER_MAP,
+  UNIFORM_BUILTIN_COUNT,
+};
+
+int shaderUniform(const char* name);
+int shaderLocation(unsigned int shader, int uniform);
+
+void shaderSetVec4Id(unsigned int shader, int uniform, vec4 dat);
+void shaderSetMat4Id(unsigned int shader, int uniform, mat4 dat);
+void shaderSetVec3Id(unsigned int shader, int uniform, vec3 dat);
+void shaderSetFloatId(unsigned int shader, int uniform, float dat);
+void shaderSetUnsignedIntId(unsigned int shader, int uniform,
+                            unsigned int dat);
+void shaderSetIntId(unsigned int shader, int uniform, int dat);
+
+// Binding point of the camera's uniform buffer. Shaders linked by
+// shaderFrom*VF that declare CAMERA_GLSL read from it.
+#define CAMERA_BINDING 0
+
+// The camera uniform block, for shaders to put after their #version line.
+#define CAMERA_GLSL                    \
+  "layout (std140) uniform Camera {\n" \
+  "mat4 proj;\n"                       \
+  "mat4 view;\n"                       \
+  "mat4 viewProj;\n"                   \
+  "mat4 ortho;\n"                      \
+  "vec3 cameraPos;\n"                  \
+  "};\n"
+
+// CAMERA_GLSL as laid out in the buffer, by std140 rules.
+typedef struct CameraBlock {
+  mat4 proj;
+  mat4 view;
+  mat4 view_proj;
+  mat4 ortho;
+  vec3 pos;
+  float pad;  // std140 takes a vec3 up to a vec4's size
+} CameraBlock;
+
+void cameraBlockInit();
+void cameraBlockUpload(CameraBlock* block);
+
 /*
  * =====
  * @FILE
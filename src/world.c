@@ -0,0 +1,434 @@
+#include "world.h"
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "ecs.h"
+#include "khash.h"
+#include "utils.h"
+
+World WORLD = {0};
+
+// every chunk we know of, by chunkKey
+KHASH_MAP_INIT_INT64(chunk, Chunk*);
+static khash_t(chunk) * CHUNKS = NULL;
+
+static inline int64_t chunkKey(int x, int z) {
+  return (int64_t)((uint64_t)(uint32_t)x << 32 | (uint32_t)z);
+}
+
+static inline int chunkCoord(float v) {
+  return (int)floorf(v / WORLD_CHUNK_SIZE);
+}
+
+static void chunkPath(const char* dir, int x, int z, char* dest, size_t n) {
+  snprintf(dest, n, "%s/chunk_%d_%d.scn", dir, x, z);
+}
+
+// how many chunks away from the camera, along the further axis
+static inline int chunkDistance(Chunk* c) {
+  return MAX(abs(c->x - WORLD.cx), abs(c->z - WORLD.cz));
+}
+
+/*
+ * ======
+ * @QUEUE
+ * ======
+ *
+ * Binary heap of queued chunks, nearest first. Only touched under WORLD.lock.
+ */
+
+static void queueSiftUp(int i) {
+  Chunk** a = WORLD.queue.a;
+  while (i > 0) {
+    int parent = (i - 1) / 2;
+    if (a[parent]->priority <= a[i]->priority) break;
+    Chunk* tmp = a[parent];
+    a[parent] = a[i];
+    a[i] = tmp;
+    i = parent;
+  }
+}
+
+static void queueSiftDown(int i) {
+  Chunk** a = WORLD.queue.a;
+  int n = WORLD.queue.n;
+  for (;;) {
+    int best = i, l = 2 * i + 1, r = l + 1;
+    if (l < n && a[l]->priority < a[best]->priority) best = l;
+    if (r < n && a[r]->priority < a[best]->priority) best = r;
+    if (best == i) break;
+    Chunk* tmp = a[best];
+    a[best] = a[i];
+    a[i] = tmp;
+    i = best;
+  }
+}
+
+static void queuePush(Chunk* c) {
+  kv_push(Chunk*, WORLD.queue, c);
+  queueSiftUp(WORLD.queue.n - 1);
+}
+
+static Chunk* queuePop() {
+  Chunk* top = WORLD.queue.a[0];
+  WORLD.queue.a[0] = WORLD.queue.a[--WORLD.queue.n];
+  queueSiftDown(0);
+  return top;
+}
+
+// squared distance from the camera to the chunk's middle
+static inline float chunkPriority(Chunk* c, vec3 camera) {
+  float dx = (c->x + 0.5f) * WORLD_CHUNK_SIZE - camera[0];
+  float dz = (c->z + 0.5f) * WORLD_CHUNK_SIZE - camera[2];
+  return dx * dx + dz * dz;
+}
+
+// Drop chunks that are no longer queued, and reorder the rest for where the
+// camera is now.
+static void queueRebuild(vec3 camera) {
+  int n = 0;
+  for (int i = 0; i < WORLD.queue.n; i++) {
+    Chunk* c = WORLD.queue.a[i];
+    if (c->state != CHUNK_QUEUED) continue;
+
+    c->priority = chunkPriority(c, camera);
+    WORLD.queue.a[n++] = c;
+  }
+
+  WORLD.queue.n = n;
+  for (int i = n / 2 - 1; i >= 0; i--) queueSiftDown(i);
+}
+
+/*
+ * =======
+ * @LOADER
+ * =======
+ */
+
+static void* worldLoader(void* arg) {
+  pthread_mutex_lock(&WORLD.lock);
+
+  while (!WORLD.quit) {
+    if (!WORLD.queue.n) {
+      pthread_cond_wait(&WORLD.wake, &WORLD.lock);
+      continue;
+    }
+
+    Chunk* c = queuePop();
+    c->state = CHUNK_LOADING;
+    pthread_mutex_unlock(&WORLD.lock);
+
+    // the disk work happens here, without the lock
+    char path[sizeof(WORLD.dir) + 64];
+    chunkPath(WORLD.dir, c->x, c->z, path, sizeof(path));
+    Scene scene = {0};
+    bool found = !access(path, R_OK) && sceneOpen(&scene, path) == Ok;
+
+    pthread_mutex_lock(&WORLD.lock);
+    c->scene = scene;
+    if (found) {
+      c->state = CHUNK_LOADED;
+      kv_push(Chunk*, WORLD.loaded, c);
+    } else {
+      c->state = CHUNK_MISSING;
+    }
+  }
+
+  pthread_mutex_unlock(&WORLD.lock);
+  return NULL;
+}
+
+/*
+ * ==========
+ * @STREAMING
+ * ==========
+ */
+
+// Start streaming the chunk files in dir. on_load, if given, sees the things
+// of every chunk that becomes resident.
+Result worldInit(const char* dir, WorldLoadFunc on_load) {
+  if (WORLD.init) return Ok;
+
+  if (strlen(dir) >= sizeof(WORLD.dir)) {
+    log_error("world directory name too long: %s", dir);
+    return Err;
+  }
+  strcpy(WORLD.dir, dir);
+  WORLD.on_load = on_load;
+  WORLD.cx = WORLD.cz = INT32_MAX;  // so the first update looks around
+  WORLD.bytes = 0;
+  WORLD.quit = false;
+  poolInit(&WORLD.chunk_pool, sizeof(Chunk), 256);
+  CHUNKS = kh_init(chunk);
+
+  pthread_mutex_init(&WORLD.lock, NULL);
+  pthread_cond_init(&WORLD.wake, NULL);
+  if (pthread_create(&WORLD.loader, NULL, worldLoader, NULL)) {
+    log_error("failed to start world loader thread");
+    exit(1);
+  }
+
+  WORLD.init = true;
+  log_info("streaming world from %s", dir);
+  return Ok;
+}
+
+static Chunk* worldChunk(int x, int z) {
+  int ret;
+  khiter_t k = kh_put(chunk, CHUNKS, chunkKey(x, z), &ret);
+  if (ret) {
+    Chunk* c = poolAlloc(&WORLD.chunk_pool);
+    *c = (Chunk){.x = x, .z = z, .state = CHUNK_UNLOADED};
+    kh_val(CHUNKS, k) = c;
+  }
+  return kh_val(CHUNKS, k);
+}
+
+// Delete a chunk's things and unmap its file. Main thread only.
+static void chunkUnload(Chunk* c) {
+  if (c->state == CHUNK_RESIDENT) {
+    for (uint32_t i = 0; i < c->scene.n_things; i++) {
+      if (thingGet(c->ids[i])) thingDelete(c->ids[i]);
+    }
+    free(c->ids);
+    c->ids = NULL;
+  }
+
+  sceneUnload(&c->scene);
+  WORLD.bytes -= c->bytes;
+  c->bytes = 0;
+  c->state = CHUNK_UNLOADED;
+}
+
+// Unload the resident chunk furthest from the camera, if it is further away
+// than distance. Returns false if there is none.
+static bool worldEvictBeyond(int distance) {
+  Chunk* worst = NULL;
+  Chunk* c;
+
+  kh_foreach_value(CHUNKS, c, {
+    if (c->state == CHUNK_RESIDENT && chunkDistance(c) > distance &&
+        (!worst || chunkDistance(c) > chunkDistance(worst))) {
+      worst = c;
+    }
+  });
+
+  if (!worst) return false;
+  chunkUnload(worst);
+  return true;
+}
+
+// The camera moved to another chunk: let go of what is now out of range and
+// queue what came into it.
+static void worldRecenter(vec3 camera) {
+  Chunk* c;
+  kvec_t(int64_t) forget = {0};
+
+  pthread_mutex_lock(&WORLD.lock);
+
+  kh_foreach_value(CHUNKS, c, {
+    if (chunkDistance(c) <= WORLD_UNLOAD_RADIUS) continue;
+
+    switch (c->state) {
+      case CHUNK_QUEUED:
+        c->state = CHUNK_UNLOADED;
+        break;
+      case CHUNK_LOADING:
+      case CHUNK_LOADED:
+        c->cancel = true;
+        break;
+      case CHUNK_RESIDENT:
+        chunkUnload(c);
+        break;
+    }
+    if (c->state == CHUNK_UNLOADED || c->state == CHUNK_MISSING) {
+      kv_push(int64_t, forget, chunkKey(c->x, c->z));
+    }
+  });
+
+  // the queue still points at the chunks just unqueued; drop them before
+  // they're freed and handed out again, and reorder the rest
+  queueRebuild(camera);
+
+  // the loader never holds on to unloaded or missing chunks
+  for (int i = 0; i < forget.n; i++) {
+    khiter_t k = kh_get(chunk, CHUNKS, forget.a[i]);
+    poolFree(&WORLD.chunk_pool, kh_val(CHUNKS, k));
+    kh_del(chunk, CHUNKS, k);
+  }
+  kv_destroy(forget);
+
+  for (int x = WORLD.cx - WORLD_LOAD_RADIUS; x <= WORLD.cx + WORLD_LOAD_RADIUS;
+       x++) {
+    for (int z = WORLD.cz - WORLD_LOAD_RADIUS;
+         z <= WORLD.cz + WORLD_LOAD_RADIUS; z++) {
+      c = worldChunk(x, z);
+      c->cancel = false;
+      if (c->state == CHUNK_UNLOADED) {
+        c->state = CHUNK_QUEUED;
+        c->priority = chunkPriority(c, camera);
+        queuePush(c);
+      }
+    }
+  }
+
+  pthread_cond_signal(&WORLD.wake);
+  pthread_mutex_unlock(&WORLD.lock);
+}
+
+// Make a mapped chunk resident, if it is still wanted and fits the budget.
+static void worldAdd(Chunk* c) {
+  if (c->cancel || chunkDistance(c) > WORLD_UNLOAD_RADIUS) {
+    chunkUnload(c);
+    return;
+  }
+
+  size_t bytes =
+      c->scene.size + (size_t)c->scene.n_things * WORLD_BYTES_PER_THING;
+  while (WORLD.bytes + bytes > WORLD_MEMORY_BUDGET &&
+         worldEvictBeyond(chunkDistance(c))) {
+  }
+  if (WORLD.bytes + bytes > WORLD_MEMORY_BUDGET) {
+    log_warn("chunk %d %d doesn't fit the world memory budget", c->x, c->z);
+    chunkUnload(c);
+    return;
+  }
+
+  c->ids = malloc(sizeof(ThingId) * (c->scene.n_things + 1));
+  if (!c->ids) {
+    log_error("failed to allocate ids for chunk %d %d", c->x, c->z);
+    exit(1);
+  }
+  if (is_err(sceneAddThings(&c->scene, c->ids))) {
+    free(c->ids);
+    c->ids = NULL;
+    sceneUnload(&c->scene);
+    c->state = CHUNK_MISSING;
+    return;
+  }
+
+  c->state = CHUNK_RESIDENT;
+  c->bytes = bytes;
+  WORLD.bytes += bytes;
+  if (WORLD.on_load) WORLD.on_load(c->ids, c->scene.n_things);
+}
+
+// Stream around the camera. Call once per frame at a point where nothing is
+// iterating things.
+void worldUpdate(vec3 camera) {
+  if (!WORLD.init) return;
+
+  int cx = chunkCoord(camera[0]), cz = chunkCoord(camera[2]);
+  if (cx != WORLD.cx || cz != WORLD.cz) {
+    WORLD.cx = cx;
+    WORLD.cz = cz;
+    worldRecenter(camera);
+  }
+
+  // take a few loaded chunks off the loader, nearest first
+  Chunk* add[WORLD_ADDS_PER_UPDATE];
+  int n_add = 0;
+
+  pthread_mutex_lock(&WORLD.lock);
+  while (WORLD.loaded.n && n_add < WORLD_ADDS_PER_UPDATE) {
+    int best = 0;
+    for (int i = 1; i < WORLD.loaded.n; i++) {
+      if (WORLD.loaded.a[i]->priority < WORLD.loaded.a[best]->priority) {
+        best = i;
+      }
+    }
+    add[n_add++] = WORLD.loaded.a[best];
+    WORLD.loaded.a[best] = WORLD.loaded.a[--WORLD.loaded.n];
+  }
+  pthread_mutex_unlock(&WORLD.lock);
+
+  for (int i = 0; i < n_add; i++) worldAdd(add[i]);
+}
+
+void worldShutdown() {
+  if (!WORLD.init) return;
+
+  pthread_mutex_lock(&WORLD.lock);
+  WORLD.quit = true;
+  pthread_cond_signal(&WORLD.wake);
+  pthread_mutex_unlock(&WORLD.lock);
+  pthread_join(WORLD.loader, NULL);
+
+  Chunk* c;
+  kh_foreach_value(CHUNKS, c, {
+    if (c->state == CHUNK_RESIDENT || c->state == CHUNK_LOADED) chunkUnload(c);
+  });
+
+  kh_destroy(chunk, CHUNKS);
+  CHUNKS = NULL;
+  kv_destroy(WORLD.queue);
+  kv_destroy(WORLD.loaded);
+  poolDestroy(&WORLD.chunk_pool);
+  pthread_mutex_destroy(&WORLD.lock);
+  pthread_cond_destroy(&WORLD.wake);
+  WORLD.init = false;
+}
+
+/*
+ * =====
+ * @BAKE
+ * =====
+ */
+
+typedef struct BakeEntry {
+  int64_t key;
+  Thing* t;
+} BakeEntry;
+
+static int bakeCompare(const void* a, const void* b) {
+  int64_t ka = ((BakeEntry*)a)->key, kb = ((BakeEntry*)b)->key;
+  return ka < kb ? -1 : ka > kb;
+}
+
+// Split every live thing into chunk files in dir, by where it is now. Makes
+// dir if it doesn't exist.
+Result worldBake(const char* dir) {
+  if (mkdir(dir, 0755) && errno != EEXIST) {
+    log_error("failed to make world directory %s", dir);
+    return Err;
+  }
+
+  BakeEntry* entries = malloc(sizeof(BakeEntry) * (THINGS.n + 1));
+  Thing** things = malloc(sizeof(Thing*) * (THINGS.n + 1));
+  if (!entries || !things) {
+    log_error("failed to allocate %u things to bake", THINGS.n);
+    exit(1);
+  }
+
+  for (uint32_t i = 0; i < THINGS.n; i++) {
+    Thing* t = THINGS.dense[i];
+    Transform* tr = ecsGet(COMP_TRANSFORM, THING_INDEX(t->id));
+    entries[i] = (BakeEntry){
+        .key = chunkKey(chunkCoord(tr->pos[0]), chunkCoord(tr->pos[2])),
+        .t = t};
+  }
+  qsort(entries, THINGS.n, sizeof(BakeEntry), bakeCompare);
+
+  Result ret = Ok;
+  int chunks = 0;
+  for (uint32_t i = 0, end; i < THINGS.n && ret == Ok; i = end) {
+    for (end = i; end < THINGS.n && entries[end].key == entries[i].key; end++) {
+      things[end - i] = entries[end].t;
+    }
+
+    char path[512];
+    int x = (int32_t)(entries[i].key >> 32), z = (int32_t)entries[i].key;
+    chunkPath(dir, x, z, path, sizeof(path));
+    ret = sceneSaveThings(path, things, end - i);
+    chunks++;
+  }
+
+  free(entries);
+  free(things);
+  if (ret == Ok) log_info("baked %u things into %d chunks", THINGS.n, chunks);
+  return ret;
+}
@@ -0,0 +1,88 @@
+#ifndef GAME_WORLD
+#define GAME_WORLD
+#include <pthread.h>
+#include <stdbool.h>
+#include "alloc.h"
+#include "kvec.h"
+#include "scene.h"
+
+/*
+ * ======
+ * @WORLD
+ * ======
+ *
+ * Streams a big world in and out in square chunks around the camera. Each
+ * chunk is a scene file, named chunk_<x>_<z>.scn, in the world directory. A
+ * loader thread maps the files nearest the camera first; worldUpdate then
+ * adds their things at a point where nothing is iterating, and deletes the
+ * things of chunks that fell out of range. Things only exist while their
+ * chunk is resident, so physics and rendering never see the rest.
+ *
+ * A thing belongs to the chunk it was loaded with, even if it moves out of
+ * it, and goes when that chunk does.
+ */
+
+// side of a chunk, in world units
+#define WORLD_CHUNK_SIZE 64.0f
+
+// chunks within this many chunks of the camera are loaded, and resident ones
+// are only dropped once further than WORLD_UNLOAD_RADIUS, so walking back and
+// forth over a border doesn't reload the same chunk
+#define WORLD_LOAD_RADIUS 2
+#define WORLD_UNLOAD_RADIUS 3
+
+// memory the resident chunks may use, see WORLD_BYTES_PER_THING
+#define WORLD_MEMORY_BUDGET (256 * 1024 * 1024)
+
+// rough memory cost of a loaded thing: record, components, body, broadphase
+#define WORLD_BYTES_PER_THING 512
+
+// loaded chunks whose things worldUpdate adds per call, to keep frames flat
+#define WORLD_ADDS_PER_UPDATE 2
+
+enum {
+  CHUNK_UNLOADED,
+  CHUNK_QUEUED,    // waiting for the loader
+  CHUNK_LOADING,   // being mapped by the loader
+  CHUNK_LOADED,    // mapped, things not added yet
+  CHUNK_RESIDENT,  // things added
+  CHUNK_MISSING,   // no file; nothing to load
+};
+
+typedef struct Chunk {
+  int x, z;
+  int state;
+  float priority;  // squared distance to the camera, nearest loads first
+  bool cancel;     // fell out of range while the loader had it
+  Scene scene;
+  ThingId* ids;  // things added from the scene
+  size_t bytes;  // what it counts against the budget
+} Chunk;
+
+// Called with the ids of the things a chunk just added.
+typedef void (*WorldLoadFunc)(ThingId* ids, uint32_t n);
+
+typedef struct World {
+  char dir[256];
+  Pool chunk_pool;
+  int cx, cz;    // chunk the camera is in
+  size_t bytes;  // memory used by resident and loaded chunks
+  WorldLoadFunc on_load;
+
+  // shared with the loader thread
+  pthread_t loader;
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  kvec_t(Chunk*) queue;   // binary heap on priority
+  kvec_t(Chunk*) loaded;  // mapped, for worldUpdate to pick up
+  bool quit;
+  bool init;
+} World;
+
+extern World WORLD;
+
+Result worldInit(const char* dir, WorldLoadFunc on_load);
+void worldUpdate(vec3 camera);
+void worldShutdown();
+Result worldBake(const char* dir);
+#endif
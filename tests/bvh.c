@@ -0,0 +1,146 @@
+#include <stdlib.h>
+
+#include "bvh.h"
+#include "test.h"
+#include "utils.h"
+
+/*
+ * =========
+ * @BVH TEST
+ * =========
+ *
+ * Batch inserts into a tree that already has leaves: boxes scattered over a
+ * wide area, a cluster small enough that its boxes share a Morton code, and
+ * copies of one box. The tree must stay well formed and shallow, and box
+ * queries must find exactly the leaves a brute force search does.
+ */
+
+#define TEST_LEAVES 6000
+#define TEST_QUERIES 300
+
+static float randf(float lo, float hi) {
+  return lo + (hi - lo) * (rand() / (float)RAND_MAX);
+}
+
+static bool boxesOverlap(vec3 amin, vec3 amax, vec3 bmin, vec3 bmax) {
+  return amin[0] <= bmax[0] && amax[0] >= bmin[0] && amin[1] <= bmax[1] &&
+         amax[1] >= bmin[1] && amin[2] <= bmax[2] && amax[2] >= bmin[2];
+}
+
+// Check the subtree at id and return how many leaves it has.
+static int checkNode(Bvh* t, int id, int parent) {
+  BvhNode* n = &t->nodes[id];
+  check(n->parent == parent, "node %d has parent %d, expected %d", id,
+        n->parent, parent);
+  if (n->height == 0) return 1;
+
+  BvhNode* l = &t->nodes[n->left];
+  BvhNode* r = &t->nodes[n->right];
+  check(n->height == 1 + MAX(l->height, r->height),
+        "node %d has height %d, its children %d and %d", id, n->height,
+        l->height, r->height);
+  for (int a = 0; a < 3; a++) {
+    check(n->min[a] <= MIN(l->min[a], r->min[a]) &&
+              n->max[a] >= MAX(l->max[a], r->max[a]),
+          "node %d doesn't contain its children", id);
+  }
+  return checkNode(t, n->left, id) + checkNode(t, n->right, id);
+}
+
+typedef struct Found {
+  char* hit;
+  int n;
+} Found;
+
+static bool queryMark(void* ctx, int leaf, void* data) {
+  Found* f = ctx;
+  f->hit[leaf]++;
+  f->n++;
+  return true;
+}
+
+static void testBatchInsert() {
+  Bvh t;
+  bvhInit(&t);
+  srand(9);
+
+  // a few leaves inserted one at a time, for the batch to join
+  int n_single = 50;
+  for (int i = 0; i < n_single; i++) {
+    vec3 min = {randf(-500, 500), randf(0, 50), randf(-500, 500)};
+    vec3 max = {min[0] + 1, min[1] + 1, min[2] + 1};
+    bvhInsert(&t, min, max, NULL);
+  }
+
+  int n = TEST_LEAVES;
+  vec3* mins = malloc(sizeof(vec3) * n * 2);
+  vec3* maxs = mins + n;
+  void** data = malloc(sizeof(void*) * n);
+  int* out = malloc(sizeof(int) * n);
+  for (int i = 0; i < n; i++) {
+    vec3 size = {1, 1, 1};
+    if (i % 3 == 0) {
+      glm_vec3_copy((vec3){randf(-500, 500), randf(0, 50), randf(-500, 500)},
+                    mins[i]);
+      glm_vec3_copy((vec3){randf(0.5f, 3), randf(0.5f, 3), randf(0.5f, 3)},
+                    size);
+    } else if (i % 3 == 1) {
+      // all within a hundredth of a unit, in a world a thousand across
+      glm_vec3_copy((vec3){i * 1e-6f, 7, 3}, mins[i]);
+    } else {
+      glm_vec3_copy((vec3){-40, 2, 60}, mins[i]);
+    }
+    glm_vec3_add(mins[i], size, maxs[i]);
+    data[i] = (void*)(intptr_t)(i + 1);
+  }
+  bvhInsertBatch(&t, n, mins, maxs, data, out);
+
+  int leaves = checkNode(&t, t.root, BVH_NULL);
+  check(leaves == n + n_single, "tree has %d leaves, %d were inserted", leaves,
+        n + n_single);
+  check(t.count == 2 * leaves - 1, "tree uses %d nodes for %d leaves", t.count,
+        leaves);
+  // ten bits of Morton code per axis, then halving runs of equal codes
+  check(t.nodes[t.root].height <= 48, "tree is %d deep",
+        t.nodes[t.root].height);
+  for (int i = 0; i < n; i++) {
+    BvhNode* leaf = &t.nodes[out[i]];
+    if (leaf->height != 0 || leaf->data != data[i]) {
+      check(false, "batch item %d isn't its leaf", i);
+      break;
+    }
+  }
+
+  // every query against a brute force search over the leaves' fat boxes
+  Found found = {calloc(t.capacity, 1), 0};
+  int wrong = 0;
+  for (int q = 0; q < TEST_QUERIES; q++) {
+    vec3 min, max;
+    if (q % 4 == 0) {
+      glm_vec3_copy((vec3){-1, 6.5f, 2.5f}, min);  // the cluster
+    } else {
+      glm_vec3_copy((vec3){randf(-520, 500), randf(-5, 50), randf(-520, 500)},
+                    min);
+    }
+    glm_vec3_add(min, (vec3){randf(1, 40), randf(1, 40), randf(1, 40)}, max);
+
+    found.n = 0;
+    bvhQueryAABB(&t, min, max, queryMark, &found);
+    for (int id = 0; id < t.capacity; id++) {
+      BvhNode* node = &t.nodes[id];
+      bool expected =
+          node->height == 0 && boxesOverlap(min, max, node->min, node->max);
+      wrong += found.hit[id] != expected;
+      found.hit[id] = 0;
+    }
+  }
+  check(!wrong, "%d leaves were wrongly found or missed", wrong);
+
+  free(found.hit);
+  free(mins);
+  free(data);
+  free(out);
+  bvhDestroy(&t);
+}
+
+void testBvh() { testBatchInsert(); }
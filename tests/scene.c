@@ -0,0 +1,202 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "ecs.h"
+#include "scene.h"
+#include "test.h"
+#include "thing.h"
+
+/*
+ * ===========
+ * @SCENE TEST
+ * ===========
+ *
+ * Saves a scene of every saveable thing type, loads it in a fresh process and
+ * checks that each thing comes back with the same components. A child process
+ * builds and saves the scene and pipes the state it expects back to the
+ * parent, whose engine state is untouched until it loads the file.
+ */
+
+#define TEST_THINGS 10000
+
+// what a thing's components should be after a round trip
+typedef struct ThingState {
+  int type;
+  vec3 pos, rot, scale;
+  vec3 halfsize, velocity;
+  float mass;
+  bool is_dynamic, is_grounded, has_color;
+  vec4 color;
+} ThingState;
+
+static void thingState(Thing* t, ThingState* s) {
+  Entity e = THING_INDEX(t->id);
+  Transform* tr = ecsGet(COMP_TRANSFORM, e);
+  Collider* c = ecsGet(COMP_COLLIDER, e);
+  Velocity* v = ecsGet(COMP_VELOCITY, e);
+  Material* m = ecsGet(COMP_MATERIAL, e);
+
+  // zeroed so padding compares equal too
+  memset(s, 0, sizeof(*s));
+  s->type = t->type;
+  glm_vec3_copy(tr->pos, s->pos);
+  glm_vec3_copy(tr->rot, s->rot);
+  glm_vec3_copy(tr->scale, s->scale);
+  glm_vec3_copy(c->halfsize, s->halfsize);
+  glm_vec3_copy(v->linear, s->velocity);
+  s->mass = c->mass;
+  s->is_dynamic = c->is_dynamic;
+  s->is_grounded = c->is_grounded;
+  s->has_color = m != NULL;
+  if (m) glm_vec4_copy(m->color, s->color);
+}
+
+// Every saveable type, some dynamic and moving, with a few deleted so the
+// live things aren't simply in slot order.
+static void buildScene() {
+  static CubeThing colors[16];
+  for (int i = 0; i < 16; i++) {
+    colors[i] = (CubeThing){.color = {i / 16.0f, 1 - i / 16.0f, 0.5f, 1}};
+  }
+  srand(4);
+
+  int types[] = {THING_CUBE, THING_TRIANGLE, THING_SQUARE};
+  Prefab prefabs[3];
+  Body body = {.scale = {1, 1, 1}};
+  for (int i = 0; i < 3; i++) {
+    prefabInit(&prefabs[i], &colors[i], types[i], &body);
+  }
+
+  int n = TEST_THINGS / 2;
+  Transform* transforms = calloc(n, sizeof(Transform));
+  for (int i = 0; i < n; i++) {
+    transforms[i] = (Transform){
+        .pos = {(i % 100) * 2.0f, (rand() % 100) * 0.1f, (i / 100) * 2.0f},
+        .rot = {rand() % 90, rand() % 90, 0},
+        .scale = {1 + (rand() % 3) * 0.5f, 1, 2},
+    };
+  }
+  thingSpawnBatch(&prefabs[0], n / 2, transforms, NULL);
+  thingSpawnBatch(&prefabs[1], n / 4, transforms + n / 2, NULL);
+  thingSpawnBatch(&prefabs[2], n - n / 2 - n / 4, transforms + n / 2 + n / 4,
+                  NULL);
+  free(transforms);
+
+  for (int i = 0; i < TEST_THINGS / 2; i++) {
+    Body b = {
+        .pos = {rand() % 200 - 100, 5 + rand() % 20, rand() % 200 - 100},
+        .scale = {1, 0.5f + (rand() % 4) * 0.5f, 1},
+        .velocity = {rand() % 7 - 3, rand() % 5, rand() % 7 - 3},
+        .mass = 1 + rand() % 10,
+        .is_dynamic = i % 3 != 0,
+    };
+    thingAdd(thingLoadFromData(&colors[i % 16], types[i % 3], &b));
+  }
+
+  Body player = {.scale = {1, 1, 1}, .halfsize = {1, 1, 1}, .is_dynamic = 1};
+  thingAdd(thingLoadFromData(NULL, THING_PLAYER, &player));
+
+  for (uint32_t i = 0; i < THINGS.n; i += 7) thingDelete(THINGS.dense[i]->id);
+}
+
+// In a child: build the scene, save it and write the expected states to fd.
+static void saveScene(const char* path, int fd) {
+  thingsInit();
+  buildScene();
+
+  if (is_err(sceneSave(path))) _exit(1);
+
+  for (uint32_t i = 0; i < THINGS.n; i++) {
+    ThingState s;
+    thingState(THINGS.dense[i], &s);
+    if (write(fd, &s, sizeof(s)) != sizeof(s)) _exit(1);
+  }
+  _exit(0);
+}
+
+static void testRoundTrip(const char* path) {
+  int fds[2];
+  if (pipe(fds)) {
+    perror("pipe");
+    exit(1);
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    exit(1);
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    saveScene(path, fds[1]);
+  }
+  close(fds[1]);
+
+  // read while the child writes, or it fills the pipe and blocks
+  kvec_t(ThingState) expected;
+  kv_init(expected);
+  ThingState s;
+  while (read(fds[0], &s, sizeof(s)) == sizeof(s)) {
+    kv_push(ThingState, expected, s);
+  }
+  close(fds[0]);
+
+  int status;
+  waitpid(pid, &status, 0);
+  check(WIFEXITED(status) && !WEXITSTATUS(status), "saving the scene failed");
+  check(expected.n > TEST_THINGS / 2, "saved only %zu things", expected.n);
+
+  thingsInit();
+  Scene scene;
+  check(sceneLoad(&scene, path) == Ok, "loading the scene failed");
+  check(THINGS.n == expected.n, "loaded %u things, saved %zu", THINGS.n,
+        expected.n);
+
+  int mismatches = 0;
+  for (uint32_t i = 0; i < THINGS.n && i < expected.n; i++) {
+    thingState(THINGS.dense[i], &s);
+    if (memcmp(&s, &expected.a[i], sizeof(s))) {
+      if (!mismatches++) {
+        fprintf(stderr, "thing %u of type %d came back different\n", i,
+                expected.a[i].type);
+      }
+    }
+  }
+  check(!mismatches, "%d things came back different", mismatches);
+
+  sceneUnload(&scene);
+  kv_destroy(expected);
+}
+
+// A things_offset close to 2^64 used to wrap the bounds check.
+static void testCorruptOffset(const char* path) {
+  FILE* f = fopen(path, "r+b");
+  SceneHeader h;
+  check(f && fread(&h, sizeof(h), 1, f) == 1, "can't reread %s", path);
+  if (!f) return;
+
+  h.things_offset = 0 - sizeof(SceneThing) * (uint64_t)h.n_things + 8;
+  rewind(f);
+  fwrite(&h, sizeof(h), 1, f);
+  fclose(f);
+
+  Scene scene;
+  check(sceneOpen(&scene, path) == Err, "a wrapping offset was accepted");
+}
+
+void testScene() {
+  char path[] = "/tmp/scene_test_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("mkstemp");
+    exit(1);
+  }
+  close(fd);
+
+  testRoundTrip(path);
+  testCorruptOffset(path);
+  unlink(path);
+}
@@ -0,0 +1,194 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ecs.h"
+#include "physics.h"
+#include "snapshot.h"
+#include "test.h"
+#include "thing.h"
+
+/*
+ * ==============
+ * @SNAPSHOT TEST
+ * ==============
+ *
+ * Cubes fall onto a floor while a snapshot ring records every tick, wrapping
+ * a few times. Rewinding must give back each tick's bodies exactly, and
+ * simulating again from there must reach the same ticks as the first time.
+ * Run under the address sanitizer, it also checks the deltas stay in bounds.
+ */
+
+#define TEST_CUBES 300
+#define TEST_RING 16
+#define TEST_TICKS 60
+
+// Sum over every body of a 64-bit FNV-1a of its thing id, position and
+// velocity, so it doesn't depend on the order of the body store.
+static uint64_t bodiesHash() {
+  uint64_t sum = 0;
+  for (int i = 0; i < BODIES.n; i++) {
+    struct {
+      ThingId id;
+      float body[6];
+    } b = {BODIES.things[i]->id,
+           {BODIES.px[i], BODIES.py[i], BODIES.pz[i], BODIES.vx[i],
+            BODIES.vy[i], BODIES.vz[i]}};
+    uint64_t h = 14695981039346656037ull;
+    unsigned char* p = (unsigned char*)&b;
+    for (size_t k = 0; k < sizeof(b); k++) h = (h ^ p[k]) * 1099511628211ull;
+    sum += h;
+  }
+  return sum;
+}
+
+// A floor with cubes above it, two in three dynamic, at random heights so
+// they land and fall asleep on different ticks.
+static void buildCubes() {
+  static CubeThing cube = {.color = {1, 1, 1, 1}};
+  srand(7);
+
+  Body floor = {.pos = {0, 0, 0}, .scale = {200, 1, 200}};
+  thingAdd(thingLoadFromData(&cube, THING_CUBE, &floor));
+
+  int side = (int)ceil(sqrt(TEST_CUBES));
+  for (int i = 0; i < TEST_CUBES; i++) {
+    Body b = {
+        .pos = {(i % side) * 3.0f - side * 1.5f, 2 + (rand() % 40) * 0.1f,
+                (i / side) * 3.0f - side * 1.5f},
+        .scale = {1, 1, 1},
+        .is_dynamic = i % 3 != 0,
+    };
+    thingAdd(thingLoadFromData(&cube, THING_CUBE, &b));
+  }
+}
+
+static void testRingRewind() {
+  SnapshotRing ring;
+  snapshotRingInit(&ring, TEST_RING);
+
+  // hashes[k] is the bodies at tick start + k
+  uint64_t hashes[TEST_TICKS + 1];
+  int start = PHYSICS.tick;
+  hashes[0] = bodiesHash();
+  snapshotRingPush(&ring);
+  for (int k = 1; k <= TEST_TICKS; k++) {
+    physicsUpdate(PHYSICS.tick_rate);
+    hashes[k] = bodiesHash();
+    snapshotRingPush(&ring);
+  }
+
+  size_t full = sizeof(uint32_t) * physicsStateSize();
+  check(snapshotRingBytes(&ring) < TEST_RING * full,
+        "a ring of %d snapshots takes %zu bytes, one takes %zu", TEST_RING,
+        snapshotRingBytes(&ring), full);
+
+  int end = start + TEST_TICKS;
+  check(snapshotRingRewind(&ring, end - TEST_RING) == Err,
+        "rewound to tick %d, which the ring dropped", end - TEST_RING);
+
+  // back a little, then to the oldest tick kept, simulating again in between
+  int targets[] = {end, end - 3, end - TEST_RING + 1};
+  for (int t = 0; t < 3; t++) {
+    int tick = targets[t];
+    check(snapshotRingRewind(&ring, tick) == Ok, "can't rewind to %d", tick);
+    check(PHYSICS.tick == tick, "rewound to tick %d, asked for %d",
+          PHYSICS.tick, tick);
+    check(bodiesHash() == hashes[tick - start],
+          "bodies differ after rewinding to tick %d", tick);
+
+    for (int k = tick + 1; k <= end; k++) {
+      physicsUpdate(PHYSICS.tick_rate);
+      check(bodiesHash() == hashes[k - start],
+            "tick %d went differently after rewinding to %d", k, tick);
+      snapshotRingPush(&ring);
+    }
+  }
+
+  snapshotRingFree(&ring);
+}
+
+// A ring of two reuses one delta for every push. Moving one more body each
+// tick makes every delta one word bigger than the last, which is what used to
+// write past the end of the reused buffer.
+static void testGrowingDeltas() {
+  SnapshotRing ring;
+  snapshotRingInit(&ring, 2);
+  snapshotRingPush(&ring);
+
+  float before[20];
+  for (int k = 1; k <= 20; k++) {
+    memcpy(before, BODIES.px, sizeof(before));
+    PHYSICS.tick++;
+    for (int i = 0; i < k; i++) BODIES.px[i] += 1;
+    snapshotRingPush(&ring);
+  }
+
+  check(snapshotRingRewind(&ring, PHYSICS.tick - 1) == Ok,
+        "can't rewind one tick");
+  check(!memcmp(BODIES.px, before, sizeof(before)),
+        "bodies differ after rewinding one tick");
+
+  snapshotRingFree(&ring);
+}
+
+// Things deleted inside the ring's window come back with their ids when it
+// rewinds to before they were deleted, and are let go once it can't.
+static void testRewindDespawn() {
+  SnapshotRing ring;
+  snapshotRingInit(&ring, TEST_RING);
+
+  uint64_t hashes[TEST_RING];
+  int start = PHYSICS.tick;
+  int despawn = start + TEST_RING / 2;
+  ThingId deleted[8];
+  for (int k = 0; k < TEST_RING; k++) {
+    if (PHYSICS.tick == despawn) {
+      for (int i = 0; i < 8; i++) {
+        deleted[i] = BODIES.things[i * 7 + 1]->id;
+        thingDelete(deleted[i]);
+      }
+    }
+    hashes[k] = bodiesHash();
+    snapshotRingPush(&ring);
+    physicsUpdate(PHYSICS.tick_rate);
+  }
+  uint32_t n_things = THINGS.n;
+  check(THINGS.graves.n == 8, "%zu deleted things kept, expected 8",
+        THINGS.graves.n);
+
+  int tick = despawn - 2;
+  check(snapshotRingRewind(&ring, tick) == Ok, "can't rewind to %d", tick);
+  check(THINGS.n == n_things + 8, "%u things after rewinding, expected %u",
+        THINGS.n, n_things + 8);
+  check(bodiesHash() == hashes[tick - start],
+        "bodies differ after rewinding past a despawn");
+  for (int i = 0; i < 8; i++) {
+    Thing* t = thingGet(deleted[i]);
+    check(t && t->proxy != BVH_NULL &&
+              ecsHas(COMP_MATERIAL, THING_INDEX(t->id)),
+          "thing %d wasn't revived whole", i);
+  }
+  check(THINGS.graves.n == 0, "%zu revived things still kept",
+        THINGS.graves.n);
+
+  // pushing on until the despawn's tick leaves the ring lets the things go
+  for (int i = 0; i < 4; i++) thingDelete(deleted[i]);
+  check(THINGS.graves.n == 4, "%zu deleted things kept, expected 4",
+        THINGS.graves.n);
+  for (int k = 0; k <= TEST_RING; k++) {
+    physicsUpdate(PHYSICS.tick_rate);
+    snapshotRingPush(&ring);
+  }
+  check(THINGS.graves.n == 0, "%zu deleted things kept past the ring",
+        THINGS.graves.n);
+
+  snapshotRingFree(&ring);
+}
+
+void testSnapshots() {
+  buildCubes();
+  testRingRewind();
+  testGrowingDeltas();
+  testRewindDespawn();
+}
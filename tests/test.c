@@ -0,0 +1,81 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "test.h"
+#include "thing.h"
+
+typedef struct Test {
+  const char* name;
+  void (*run)();
+} Test;
+
+static const Test TESTS[] = {
+    {"bvh", testBvh},
+    {"scene", testScene},
+    {"snapshot", testSnapshots},
+    {"world", testWorld},
+};
+
+#define N_TESTS (int)(sizeof(TESTS) / sizeof(TESTS[0]))
+
+int FAILURES = 0;
+
+// Run a suite in a child process on fresh engine state, Err if any check
+// failed or it crashed.
+static Result runTest(const Test* t) {
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    return Err;
+  }
+
+  if (pid == 0) {
+    thingsInit();
+    t->run();
+    fflush(stdout);
+    _exit(FAILURES ? 1 : 0);
+  }
+
+  int status;
+  if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+      WEXITSTATUS(status)) {
+    return Err;
+  }
+  return Ok;
+}
+
+int main(int argc, char** argv) {
+  LOGGER.out = getenv("TEST_LOG") ? stderr : fopen("/dev/null", "w");
+
+  for (int a = 1; a < argc; a++) {
+    bool known = false;
+    for (int i = 0; i < N_TESTS; i++) known |= !strcmp(argv[a], TESTS[i].name);
+    if (!known) {
+      fprintf(stderr, "no test called %s\n", argv[a]);
+      return 1;
+    }
+  }
+
+  int failed = 0;
+  for (int i = 0; i < N_TESTS; i++) {
+    const Test* t = &TESTS[i];
+
+    bool wanted = argc < 2;
+    for (int a = 1; a < argc; a++) wanted |= !strcmp(argv[a], t->name);
+    if (!wanted) continue;
+
+    if (is_err(runTest(t))) {
+      fprintf(stderr, "%s: failed\n", t->name);
+      failed++;
+    } else {
+      printf("%s: ok\n", t->name);
+    }
+  }
+
+  return failed ? 1 : 0;
+}
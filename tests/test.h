@@ -0,0 +1,35 @@
+#ifndef GAME_TEST
+#define GAME_TEST
+#include <stdio.h>
+
+#include "log.h"
+
+/*
+ * =====
+ * @TEST
+ * =====
+ *
+ * Headless tests, built with the address and undefined behaviour sanitizers.
+ * `make test` runs every suite; `./REPLACEMENT_TEST scene` runs only those
+ * named. Each suite runs in its own forked process on fresh engine state.
+ * Engine logging goes to /dev/null; set TEST_LOG to see it on stderr.
+ */
+
+// failed checks in this process
+extern int FAILURES;
+
+#define check(cond, ...)                                   \
+  do {                                                     \
+    if (!(cond)) {                                         \
+      fprintf(stderr, "FAIL %s:%d: ", __FILE__, __LINE__); \
+      fprintf(stderr, __VA_ARGS__);                        \
+      fprintf(stderr, "\n");                               \
+      FAILURES++;                                          \
+    }                                                      \
+  } while (0)
+
+void testBvh();
+void testScene();
+void testSnapshots();
+void testWorld();
+#endif
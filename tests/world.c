@@ -0,0 +1,156 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ecs.h"
+#include "test.h"
+#include "thing.h"
+#include "utils.h"
+#include "world.h"
+
+/*
+ * ===========
+ * @WORLD TEST
+ * ===========
+ *
+ * A square of chunks, each with a few cubes, is baked into a world directory
+ * and streamed back in around a camera walking across it. Wherever the camera
+ * stops, every chunk in load range must be resident, none beyond the unload
+ * range may be, and the resident chunks must fit the memory budget.
+ */
+
+// chunks along each side of the world, and cubes in each chunk
+#define TEST_SIDE 10
+#define TEST_CUBES 6
+
+static int cubesInChunk[TEST_SIDE][TEST_SIDE];
+
+static void buildWorld() {
+  static CubeThing cube = {.color = {1, 1, 1, 1}};
+
+  for (int x = 0; x < TEST_SIDE; x++) {
+    for (int z = 0; z < TEST_SIDE; z++) {
+      for (int i = 0; i < TEST_CUBES; i++) {
+        Body b = {
+            .pos = {(x + 0.1f + i * 0.15f) * WORLD_CHUNK_SIZE, 0.5f,
+                    (z + 0.5f) * WORLD_CHUNK_SIZE},
+            .scale = {1, 1, 1},
+        };
+        thingAdd(thingLoadFromData(&cube, THING_CUBE, &b));
+      }
+    }
+  }
+}
+
+// Count the live things in each chunk of the world, by where they are.
+static void countThings() {
+  memset(cubesInChunk, 0, sizeof(cubesInChunk));
+  for (uint32_t i = 0; i < THINGS.n; i++) {
+    Transform* tr = ecsGet(COMP_TRANSFORM, THING_INDEX(THINGS.dense[i]->id));
+    int x = (int)floorf(tr->pos[0] / WORLD_CHUNK_SIZE);
+    int z = (int)floorf(tr->pos[2] / WORLD_CHUNK_SIZE);
+    if (x >= 0 && x < TEST_SIDE && z >= 0 && z < TEST_SIDE) {
+      cubesInChunk[x][z]++;
+    }
+  }
+}
+
+static int chunksAway(int x, int z, int cx, int cz) {
+  return MAX(abs(x - cx), abs(z - cz));
+}
+
+// Update the world until every chunk in load range of the camera is resident,
+// or a few seconds pass. Returns false if it timed out.
+static bool streamUntilLoaded(vec3 camera, int cx, int cz) {
+  for (int tries = 0; tries < 5000; tries++) {
+    worldUpdate(camera);
+    countThings();
+
+    bool loaded = true;
+    for (int x = 0; x < TEST_SIDE; x++) {
+      for (int z = 0; z < TEST_SIDE; z++) {
+        if (chunksAway(x, z, cx, cz) <= WORLD_LOAD_RADIUS) {
+          loaded &= cubesInChunk[x][z] == TEST_CUBES;
+        }
+      }
+    }
+    if (loaded) return true;
+    usleep(1000);
+  }
+  return false;
+}
+
+static void testStreaming(const char* dir) {
+  check(worldInit(dir, NULL) == Ok, "can't stream from %s", dir);
+
+  // diagonally across the world in half chunk steps, then back along an edge
+  int steps = 2 * (TEST_SIDE - 1);
+  for (int s = 0; s <= 2 * steps; s++) {
+    float along = MIN(s, steps) * 0.5f + 0.25f;
+    float back = MAX(s - steps, 0) * 0.5f;
+    vec3 camera = {(along - back) * WORLD_CHUNK_SIZE, 2,
+                   along * WORLD_CHUNK_SIZE};
+    int cx = (int)floorf(camera[0] / WORLD_CHUNK_SIZE);
+    int cz = (int)floorf(camera[2] / WORLD_CHUNK_SIZE);
+
+    if (!streamUntilLoaded(camera, cx, cz)) {
+      check(false, "chunks around %d %d didn't load", cx, cz);
+      break;
+    }
+
+    int resident = 0;
+    for (int x = 0; x < TEST_SIDE; x++) {
+      for (int z = 0; z < TEST_SIDE; z++) {
+        int n = cubesInChunk[x][z];
+        check(n == 0 || n == TEST_CUBES, "chunk %d %d has %d of its cubes", x,
+              z, n);
+        check(!n || chunksAway(x, z, cx, cz) <= WORLD_UNLOAD_RADIUS,
+              "chunk %d %d is still resident with the camera in %d %d", x, z,
+              cx, cz);
+        resident += n == TEST_CUBES;
+      }
+    }
+    check(WORLD.bytes <= WORLD_MEMORY_BUDGET,
+          "resident chunks take %zu bytes, over the budget", WORLD.bytes);
+    check(WORLD.bytes >= (size_t)resident * TEST_CUBES * WORLD_BYTES_PER_THING,
+          "%d resident chunks only count %zu bytes", resident, WORLD.bytes);
+  }
+
+  worldShutdown();
+  check(THINGS.n == 0, "%u things left after shutting the world down",
+        THINGS.n);
+}
+
+void testWorld() {
+  char dir[] = "/tmp/world_test_XXXXXX";
+  if (!mkdtemp(dir)) {
+    check(false, "can't make a directory for the world");
+    return;
+  }
+
+  buildWorld();
+  check(worldBake(dir) == Ok, "can't bake the world into %s", dir);
+  thingsUnloadLevel();
+
+  char path[sizeof(dir) + 64];
+  for (int x = -1; x <= TEST_SIDE; x++) {
+    for (int z = -1; z <= TEST_SIDE; z++) {
+      bool inside = x >= 0 && x < TEST_SIDE && z >= 0 && z < TEST_SIDE;
+      snprintf(path, sizeof(path), "%s/chunk_%d_%d.scn", dir, x, z);
+      check(!access(path, R_OK) == inside, "chunk %d %d was%s baked", x, z,
+            inside ? "n't" : "");
+    }
+  }
+
+  testStreaming(dir);
+
+  for (int x = 0; x < TEST_SIDE; x++) {
+    for (int z = 0; z < TEST_SIDE; z++) {
+      snprintf(path, sizeof(path), "%s/chunk_%d_%d.scn", dir, x, z);
+      unlink(path);
+    }
+  }
+  rmdir(dir);
+}